@@ -0,0 +1,48 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+// Builds little-endian binary payloads independent of the host byte order.
+class BinaryWriter {
+public:
+    void u8(uint8_t v) { data_.push_back(static_cast<char>(v)); }
+
+    void u16(uint16_t v) {
+        u8(v & 0xFF);
+        u8(v >> 8);
+    }
+
+    void u32(uint32_t v) {
+        u16(v & 0xFFFF);
+        u16(v >> 16);
+    }
+
+    void i16(int16_t v) { u16(static_cast<uint16_t>(v)); }
+
+    void i32(int32_t v) { u32(static_cast<uint32_t>(v)); }
+
+    // Stores round(v * scale), saturated to the range of T
+    template<typename T>
+    static T quantize(double v, double scale) {
+        const double scaled = std::round(v * scale);
+        if (!(scaled == scaled))
+            return 0;
+        return static_cast<T>(std::clamp(scaled, static_cast<double>(std::numeric_limits<T>::min()),
+                                         static_cast<double>(std::numeric_limits<T>::max())));
+    }
+
+    const std::string &data() const { return data_; }
+
+    size_t size() const { return data_.size(); }
+
+    void reserve(size_t size) { data_.reserve(size); }
+
+    void clear() { data_.clear(); }
+
+private:
+    std::string data_;
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ros/time.h"
+#include "xbot_msgs/SensorInfo.h"
+#include "xbot_msgs/RobotState.h"
+#include "xbot_msgs/Map.h"
+#include "xbot_msgs/MapOverlay.h"
+#include "xbot_msgs/ActionInfo.h"
+#include "xbot_monitoring/egress.h"
+#include "xbot_monitoring/ingress.h"
+
+// The bridge logic, independent of the ROS node and the MQTT client.
+// The state is process wide: call bridge_init() once, then feed it from the adapter (see xbot_monitoring.cpp).
+// It still uses the message types, ros::Time and rosconsole, which all work without a ROS master.
+// Call ros::Time::init() if there is no ros::init().
+
+struct BridgeConfig {
+    // Samples kept per double sensor
+    int history_size = 1024;
+    // Hysteresis for clearing alarms, relative to the sensor's range
+    double alarm_hysteresis = 0.02;
+
+    // If enabled, robot_state is only published fully every robot_state_keyframe_interval seconds.
+    // In between, only the fields which differ from the last keyframe are published on robot_state/delta.
+    bool robot_state_delta = false;
+    double robot_state_keyframe_interval = 5.0;
+    // If enabled, the pose is additionally published on robot_state/pose/bin and the rest on robot_state/status (only on change)
+    bool robot_state_split = true;
+
+    bool trail_enabled = true;
+    double trail_min_distance = 0.1;
+    double trail_min_angle = 0.2;
+    double trail_max_age = 600.0;
+    int trail_max_points = 5000;
+    // The full trail is republished (retained) in this interval, in between only appended points are sent
+    double trail_publish_interval = 10.0;
+
+    // Obstacles further away than this are not reported
+    double obstacle_proximity_radius = 2.0;
+    // Map and overlay are split into tiles of map_tile_size meters (0 to disable)
+    double map_tile_size = 0.0;
+
+    // A zero twist is sent if no teleop command arrived for teleop_timeout seconds
+    double teleop_timeout = 0.5;
+    // Teleop commands with a timestamp older than this are dropped (0 to disable).
+    // Together with the seq, this keeps commands queued during a link stall from moving the robot.
+    double teleop_max_age = 1.0;
+
+    // The flattened list of all actions on actions/json and actions/bson, in addition to the per node topics
+    bool publish_full_action_list = false;
+
+    // Topic prefixes which are buffered while the broker is unreachable, empty to disable
+    std::vector<std::string> offline_buffer_topics;
+    // "ordered" or "latest"
+    std::string offline_buffer_mode = "ordered";
+    int offline_buffer_max_size_kb = 1024;
+    std::string offline_buffer_spill_path;
+    int offline_buffer_max_spill_size_mb = 64;
+    // Max number of buffered messages to replay per second
+    double offline_buffer_replay_rate = 50.0;
+
+    // Directory for the persistent history log, empty to disable
+    std::string history_log_dir;
+    int history_log_segment_size_mb = 16;
+    int history_log_max_segments = 8;
+};
+
+// An inbound MQTT message
+struct InboundMessage {
+    std::string topic;
+    std::string payload;
+};
+using InboundMessagePtr = std::shared_ptr<const InboundMessage>;
+
+// A sensor known to the bridge, valid until the process exits
+struct Sensor;
+
+// egress and ingress have to outlive the bridge
+void bridge_init(const BridgeConfig &config, Egress &egress, Ingress &ingress);
+
+// Starts the inbound worker thread and the offline replay thread
+void bridge_start();
+
+void bridge_stop();
+
+// Robot side
+
+bool has_sensor(const std::string &topic);
+
+// Registers the sensor announced on topic and republishes the sensor infos.
+// Returns nullptr if the sensor's value type is invalid.
+const Sensor *add_sensor(const std::string &topic, const xbot_msgs::SensorInfo &info);
+
+// stamp is the message stamp, zero if unknown
+void sensor_double_callback(const Sensor &sensor, double value, const ros::Time &stamp);
+
+void sensor_string_callback(const Sensor &sensor, const std::string &value, const ros::Time &stamp);
+
+void robot_state_callback(const xbot_msgs::RobotState &msg);
+
+void map_callback(const xbot_msgs::Map &msg);
+
+void map_overlay_callback(const xbot_msgs::MapOverlay &msg);
+
+void register_actions(const std::string &node_prefix, const std::vector<xbot_msgs::ActionInfo> &actions);
+
+// Broker side
+
+void handle_connected();
+
+void handle_connection_lost();
+
+void handle_inbound_message(const InboundMessagePtr &msg);
+
+// Periodic tasks, called by the adapter's timers
+
+// Stops the robot if the teleop client went quiet, call at least every teleop_timeout / 4 seconds
+void teleop_watchdog_callback();
+
+void publish_teleop_latency();
+
+void publish_sensor_latency();
+
+void publish_metrics();
+
+// Registers the bridge's own resource usage as sensors, published by self_monitoring_callback()
+void setup_self_monitoring();
+
+void self_monitoring_callback();
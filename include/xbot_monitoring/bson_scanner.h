@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Reads single top level fields straight from a BSON buffer without building a document.
+// Meant for small, flat messages on hot paths (e.g. /teleop).
+class BsonScanner {
+public:
+    BsonScanner(const void *data, size_t size) : data_(static_cast<const uint8_t *>(data)), size_(size) {
+        // Document: int32 total size, elements, 0x00
+        valid_ = size_ >= 5 && read_i32(0) >= 5 && static_cast<size_t>(read_i32(0)) <= size_ &&
+                 data_[read_i32(0) - 1] == 0;
+        if (valid_)
+            size_ = read_i32(0);
+    }
+
+    bool valid() const { return valid_; }
+
+    // Reads a numeric field (double, int32 or int64) as double.
+    bool get_double(const char *key, double &out) const {
+        size_t offset;
+        switch (find(key, offset)) {
+            case TYPE_DOUBLE: {
+                const uint64_t bits = read_u64(offset);
+                memcpy(&out, &bits, sizeof(out));
+                return true;
+            }
+            case TYPE_INT32:
+                out = read_i32(offset);
+                return true;
+            case TYPE_INT64:
+                out = static_cast<double>(static_cast<int64_t>(read_u64(offset)));
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Reads an integer field (int32 or int64, or a double without fraction).
+    bool get_int64(const char *key, int64_t &out) const {
+        size_t offset;
+        switch (find(key, offset)) {
+            case TYPE_INT32:
+                out = read_i32(offset);
+                return true;
+            case TYPE_INT64:
+                out = static_cast<int64_t>(read_u64(offset));
+                return true;
+            case TYPE_DOUBLE: {
+                double d;
+                const uint64_t bits = read_u64(offset);
+                memcpy(&d, &bits, sizeof(d));
+                // Casting NaN or anything outside [INT64_MIN, INT64_MAX) is undefined, INT64_MAX itself isn't a double
+                if (!std::isfinite(d) || d < -9223372036854775808.0 || d >= 9223372036854775808.0)
+                    return false;
+                out = static_cast<int64_t>(d);
+                return static_cast<double>(out) == d;
+            }
+            default:
+                return false;
+        }
+    }
+
+private:
+    enum ElementType : uint8_t {
+        TYPE_NONE = 0x00,
+        TYPE_DOUBLE = 0x01,
+        TYPE_STRING = 0x02,
+        TYPE_DOCUMENT = 0x03,
+        TYPE_ARRAY = 0x04,
+        TYPE_BINARY = 0x05,
+        TYPE_OBJECT_ID = 0x07,
+        TYPE_BOOL = 0x08,
+        TYPE_DATETIME = 0x09,
+        TYPE_NULL = 0x0A,
+        TYPE_INT32 = 0x10,
+        TYPE_TIMESTAMP = 0x11,
+        TYPE_INT64 = 0x12,
+        TYPE_DECIMAL128 = 0x13,
+    };
+
+    // Returns the element type and the offset of its value, TYPE_NONE if the key wasn't found.
+    uint8_t find(const char *key, size_t &value_offset) const {
+        if (!valid_)
+            return TYPE_NONE;
+
+        const size_t key_length = strlen(key);
+        size_t offset = 4;
+        // The last byte is the document terminator
+        while (offset < size_ - 1) {
+            const uint8_t type = data_[offset++];
+            const auto *name = reinterpret_cast<const char *>(data_ + offset);
+            const size_t name_length = strnlen(name, size_ - 1 - offset);
+            if (offset + name_length >= size_ - 1)
+                return TYPE_NONE;
+            offset += name_length + 1;
+
+            size_t value_size;
+            if (!element_size(type, offset, value_size) || offset + value_size > size_ - 1)
+                return TYPE_NONE;
+
+            if (name_length == key_length && memcmp(name, key, key_length) == 0) {
+                value_offset = offset;
+                return type;
+            }
+            offset += value_size;
+        }
+        return TYPE_NONE;
+    }
+
+    bool element_size(uint8_t type, size_t offset, size_t &value_size) const {
+        switch (type) {
+            case TYPE_DOUBLE:
+            case TYPE_DATETIME:
+            case TYPE_TIMESTAMP:
+            case TYPE_INT64:
+                value_size = 8;
+                return true;
+            case TYPE_INT32:
+                value_size = 4;
+                return true;
+            case TYPE_BOOL:
+                value_size = 1;
+                return true;
+            case TYPE_NULL:
+                value_size = 0;
+                return true;
+            case TYPE_OBJECT_ID:
+                value_size = 12;
+                return true;
+            case TYPE_DECIMAL128:
+                value_size = 16;
+                return true;
+            case TYPE_STRING:
+            case TYPE_BINARY:
+            case TYPE_DOCUMENT:
+            case TYPE_ARRAY: {
+                if (offset + 4 > size_)
+                    return false;
+                const int32_t length = read_i32(offset);
+                if (length < 0)
+                    return false;
+                value_size = static_cast<size_t>(length);
+                // Strings and binaries are prefixed with their length (and binaries have a subtype)
+                if (type == TYPE_STRING)
+                    value_size += 4;
+                if (type == TYPE_BINARY)
+                    value_size += 5;
+                return true;
+            }
+            default:
+                // Something we can't skip
+                return false;
+        }
+    }
+
+    int32_t read_i32(size_t offset) const {
+        return static_cast<int32_t>(static_cast<uint32_t>(data_[offset]) |
+                                    static_cast<uint32_t>(data_[offset + 1]) << 8 |
+                                    static_cast<uint32_t>(data_[offset + 2]) << 16 |
+                                    static_cast<uint32_t>(data_[offset + 3]) << 24);
+    }
+
+    uint64_t read_u64(size_t offset) const {
+        return static_cast<uint32_t>(read_i32(offset)) |
+               static_cast<uint64_t>(static_cast<uint32_t>(read_i32(offset + 4))) << 32;
+    }
+
+    const uint8_t *data_;
+    size_t size_;
+    bool valid_;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstring>
+
+#include "xbot_monitoring/binary_writer.h"
+
+// Writes a flat BSON document field by field, for small messages on hot paths.
+class BsonWriter {
+public:
+    BsonWriter() {
+        // Placeholder for the document size
+        w_.u32(0);
+    }
+
+    void add_double(const char *key, double value) {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        key_(0x01, key);
+        w_.u32(static_cast<uint32_t>(bits));
+        w_.u32(static_cast<uint32_t>(bits >> 32));
+    }
+
+    void add_int64(const char *key, int64_t value) {
+        key_(0x12, key);
+        w_.u32(static_cast<uint32_t>(value));
+        w_.u32(static_cast<uint32_t>(static_cast<uint64_t>(value) >> 32));
+    }
+
+    void add_bool(const char *key, bool value) {
+        key_(0x08, key);
+        w_.u8(value ? 1 : 0);
+    }
+
+    // Terminates the document and returns it. Don't add fields afterwards.
+    const std::string &finish() {
+        w_.u8(0);
+        data_ = w_.data();
+        const auto size = static_cast<uint32_t>(data_.size());
+        for (int i = 0; i < 4; i++) {
+            data_[i] = static_cast<char>((size >> (8 * i)) & 0xFF);
+        }
+        return data_;
+    }
+
+private:
+    void key_(uint8_t type, const char *key) {
+        w_.u8(type);
+        for (const char *c = key; *c != 0; c++) {
+            w_.u8(static_cast<uint8_t>(*c));
+        }
+        w_.u8(0);
+    }
+
+    BinaryWriter w_;
+    std::string data_;
+};
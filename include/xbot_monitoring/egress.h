@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Where the bridge publishes to, the MQTT broker in production.
+// Called from several threads at once, implementations have to be thread safe.
+class Egress {
+public:
+    virtual ~Egress() = default;
+
+    virtual bool is_connected() = 0;
+
+    // Returns false if the message couldn't be handed over, e.g. because the connection just dropped.
+    // Retained messages have to arrive at least once.
+    virtual bool publish(const std::string &topic, const void *data, size_t size, bool retain) = 0;
+
+    // Called for each inbound topic filter after connecting
+    virtual void subscribe(const std::string &filter) = 0;
+
+    // Number of messages handed over but not delivered yet
+    virtual size_t pending() = 0;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include "ros/time.h"
+#include "xbot_msgs/SensorInfo.h"
+#include "xbot_msgs/RobotState.h"
+#include "xbot_msgs/Map.h"
+#include "xbot_msgs/MapOverlay.h"
+#include "xbot_monitoring/binary_writer.h"
+#include "xbot_monitoring/map_index.h"
+
+// Conversions from the ROS messages to what gets published. Kept free of any MQTT and ROS node state,
+// so they can be benchmarked on their own.
+
+// One entry of sensor_infos
+nlohmann::json sensor_info_to_json(const xbot_msgs::SensorInfo &info);
+
+// The sensors/<id>/bson document: {"d": value, "t": stamp in us}
+nlohmann::json sensor_value_to_json(nlohmann::json value, const ros::Time &stamp);
+
+// The robot_state document
+nlohmann::json robot_state_to_json(const xbot_msgs::RobotState &msg);
+
+// The 18 byte robot_state/pose/bin frame
+void encode_robot_pose(const xbot_msgs::RobotState &msg, uint16_t seq, BinaryWriter &w);
+
+// The map document
+nlohmann::json map_to_json(const xbot_msgs::Map &msg);
+
+// Areas and obstacles of the map for the summary, tiles and the spatial index
+std::vector<MapPolygon> map_polygons(const xbot_msgs::Map &msg);
+
+// The map_overlay document
+nlohmann::json map_overlay_to_json(const xbot_msgs::MapOverlay &msg);
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+struct Point2 {
+    double x;
+    double y;
+};
+
+struct BoundingBox {
+    double min_x = std::numeric_limits<double>::infinity();
+    double min_y = std::numeric_limits<double>::infinity();
+    double max_x = -std::numeric_limits<double>::infinity();
+    double max_y = -std::numeric_limits<double>::infinity();
+
+    bool empty() const { return min_x > max_x; }
+
+    void extend(const Point2 &p) {
+        min_x = std::min(min_x, p.x);
+        min_y = std::min(min_y, p.y);
+        max_x = std::max(max_x, p.x);
+        max_y = std::max(max_y, p.y);
+    }
+
+    void extend(const BoundingBox &other) {
+        min_x = std::min(min_x, other.min_x);
+        min_y = std::min(min_y, other.min_y);
+        max_x = std::max(max_x, other.max_x);
+        max_y = std::max(max_y, other.max_y);
+    }
+
+    bool contains(const Point2 &p) const {
+        return p.x >= min_x && p.x <= max_x && p.y >= min_y && p.y <= max_y;
+    }
+
+    // Distance from p to the box, 0 if p is inside
+    double distance(const Point2 &p) const {
+        const double dx = std::max({min_x - p.x, 0.0, p.x - max_x});
+        const double dy = std::max({min_y - p.y, 0.0, p.y - max_y});
+        return std::hypot(dx, dy);
+    }
+
+    Point2 center() const { return {(min_x + max_x) / 2.0, (min_y + max_y) / 2.0}; }
+};
+
+inline BoundingBox polygon_bounds(const std::vector<Point2> &polygon) {
+    BoundingBox bounds;
+    for (const auto &p: polygon) {
+        bounds.extend(p);
+    }
+    return bounds;
+}
+
+// Even-odd rule, the polygon is implicitly closed.
+inline bool point_in_polygon(const Point2 &p, const std::vector<Point2> &polygon) {
+    bool inside = false;
+    for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+        const auto &a = polygon[i];
+        const auto &b = polygon[j];
+        if ((a.y > p.y) != (b.y > p.y) && p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y) + a.x) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+inline double point_segment_distance(const Point2 &p, const Point2 &a, const Point2 &b) {
+    const double dx = b.x - a.x;
+    const double dy = b.y - a.y;
+    const double length_sq = dx * dx + dy * dy;
+    double t = 0;
+    if (length_sq > 0) {
+        t = std::clamp(((p.x - a.x) * dx + (p.y - a.y) * dy) / length_sq, 0.0, 1.0);
+    }
+    return std::hypot(p.x - (a.x + t * dx), p.y - (a.y + t * dy));
+}
+
+// Distance from p to the closest edge of the (closed) polygon
+inline double point_polygon_distance(const Point2 &p, const std::vector<Point2> &polygon) {
+    double distance = std::numeric_limits<double>::infinity();
+    for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+        distance = std::min(distance, point_segment_distance(p, polygon[j], polygon[i]));
+    }
+    return distance;
+}
+
+// Shoelace formula, always positive
+inline double polygon_area(const std::vector<Point2> &polygon) {
+    double sum = 0;
+    for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+        sum += polygon[j].x * polygon[i].y - polygon[i].x * polygon[j].y;
+    }
+    return std::abs(sum) / 2.0;
+}
+
+inline double polygon_perimeter(const std::vector<Point2> &polygon) {
+    double length = 0;
+    for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+        length += std::hypot(polygon[i].x - polygon[j].x, polygon[i].y - polygon[j].y);
+    }
+    return length;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// On-disk format of the history log.
+// A log is a directory of fixed size segment files, each one starting with a LogSegmentHeader
+// followed by fixed size LogRecords. Unused records are zero (stamp_ns == 0), so readers can
+// stop at the first empty record even if the writer crashed before updating record_count.
+
+#define XBOT_LOG_MAGIC "XBOTLOG"
+#define XBOT_LOG_VERSION 1
+
+struct LogSegmentHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;
+    uint64_t record_count;
+    uint64_t segment_index;
+    char reserved[24];
+};
+
+enum LogRecordType : uint16_t {
+    // Defines the name (text) for a channel id. Repeated at the start of every segment.
+    LOG_RECORD_CHANNEL = 1,
+    // values[0] = sensor value
+    LOG_RECORD_SENSOR_DOUBLE = 2,
+    // text = sensor value (truncated)
+    LOG_RECORD_SENSOR_STRING = 3,
+    // values = x, y, heading; flags bit 0 = heading valid
+    LOG_RECORD_ROBOT_POSE = 4,
+    // values = battery, gps, action progress; flags bit 0 = charging, bit 1 = emergency; text = current state
+    LOG_RECORD_ROBOT_STATUS = 5,
+};
+
+struct LogRecord {
+    uint64_t stamp_ns;
+    uint16_t type;
+    uint16_t channel;
+    uint32_t flags;
+    double values[3];
+    char text[24];
+};
+
+static_assert(sizeof(LogSegmentHeader) == 64, "unexpected LogSegmentHeader size");
+static_assert(sizeof(LogRecord) == 64, "unexpected LogRecord size");
+
+// Append-only log of LogRecords into memory-mapped segment files.
+// append() only copies the record into a queue, the disk I/O happens on a background thread.
+class HistoryLog {
+public:
+    HistoryLog(std::string directory, size_t segment_size, size_t max_segments);
+    ~HistoryLog();
+
+    // Opens the next segment and starts the writer thread.
+    bool start();
+    void stop();
+
+    // Returns the channel id for the name, registering it if needed.
+    uint16_t channel(const std::string &name);
+
+    // Queues a record for writing. Never blocks on I/O, drops the record if the queue is full.
+    void append(const LogRecord &record);
+
+    uint64_t dropped() const { return dropped_; }
+
+    // Copies text into a record's text field (truncated, always zero terminated).
+    static void set_text(LogRecord &record, const std::string &text);
+
+    static std::string segment_path(const std::string &directory, uint64_t index);
+
+private:
+    void run();
+    bool open_segment();
+    void close_segment();
+    void write_record(const LogRecord &record);
+    void remove_old_segments();
+
+    const std::string directory_;
+    const size_t segment_size_;
+    const size_t max_segments_;
+
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    std::vector<LogRecord> queue_;
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> running_{false};
+    std::thread writer_thread_;
+
+    std::mutex channels_mutex_;
+    std::vector<std::string> channels_;
+
+    // Only accessed by the writer thread after start()
+    int fd_ = -1;
+    LogSegmentHeader *header_ = nullptr;
+    LogRecord *records_ = nullptr;
+    // Size of the current segment, larger than segment_size_ if the channel definitions need it
+    size_t mapped_size_ = 0;
+    uint64_t next_segment_index_ = 0;
+    std::chrono::steady_clock::time_point next_open_attempt_;
+};
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "xbot_monitoring/trace.h"
+
+// Matches an MQTT topic against a subscription filter with + and # wildcards.
+inline bool topic_matches(const std::string &filter, const std::string &topic) {
+    size_t f = 0, t = 0;
+    while (f < filter.size()) {
+        if (filter[f] == '#') {
+            // Also matches the parent level ("a/#" matches "a")
+            return true;
+        }
+        if (filter[f] == '+') {
+            while (t < topic.size() && topic[t] != '/')
+                t++;
+            f++;
+        } else {
+            if (t >= topic.size() || filter[f] != topic[t]) {
+                // "a/#" matches "a"
+                return t == topic.size() && filter.compare(f, std::string::npos, "/#") == 0;
+            }
+            f++;
+            t++;
+        }
+    }
+    return t == topic.size();
+}
+
+// Dispatches inbound messages to the handler registered for their topic.
+// Exact topics are looked up in a hash map, wildcard filters are only checked if there was no exact match.
+// Handlers either run inline (on the MQTT client's callback thread) or on the router's worker thread.
+template<typename Message>
+class InboundRouter {
+public:
+    using Handler = std::function<void(const Message &)>;
+    // Called with the topic and the time a message spent in the worker queue
+    using QueueDelayCallback = std::function<void(const std::string &, uint64_t)>;
+
+    enum class Context {
+        // For cheap, latency sensitive handlers
+        INLINE,
+        // For everything which might block, keeps the MQTT callback thread free
+        WORKER
+    };
+
+    explicit InboundRouter(size_t max_queue_size = 256) : max_queue_size_(max_queue_size) {
+    }
+
+    ~InboundRouter() {
+        stop();
+    }
+
+    // Register all handlers before calling start().
+    void add(const std::string &filter, Context context, Handler handler) {
+        Route route{filter, context, std::move(handler)};
+        if (filter.find_first_of("+#") == std::string::npos) {
+            exact_routes_[filter] = std::move(route);
+        } else {
+            wildcard_routes_.push_back(std::move(route));
+        }
+    }
+
+    void set_queue_delay_callback(QueueDelayCallback callback) {
+        queue_delay_callback_ = std::move(callback);
+    }
+
+    void start() {
+        running_ = true;
+        worker_ = std::thread(&InboundRouter::run, this);
+    }
+
+    void stop() {
+        {
+            std::unique_lock<std::mutex> lk(queue_mutex_);
+            if (!running_)
+                return;
+            running_ = false;
+        }
+        queue_cv_.notify_all();
+        worker_.join();
+    }
+
+    // Returns false if no handler was registered for the topic or the worker queue was full.
+    bool dispatch(const std::string &topic, const Message &message) {
+        const Route *route = nullptr;
+        auto it = exact_routes_.find(topic);
+        if (it != exact_routes_.end()) {
+            route = &it->second;
+        } else {
+            for (const auto &wildcard_route: wildcard_routes_) {
+                if (topic_matches(wildcard_route.filter, topic)) {
+                    route = &wildcard_route;
+                    break;
+                }
+            }
+        }
+        if (route == nullptr)
+            return false;
+
+        if (route->context == Context::INLINE) {
+            route->handler(message);
+            return true;
+        }
+
+        {
+            std::unique_lock<std::mutex> lk(queue_mutex_);
+            if (queue_.size() >= max_queue_size_)
+                return false;
+            queue_.push_back({route, topic, message, std::chrono::steady_clock::now()});
+        }
+        queue_cv_.notify_one();
+        return true;
+    }
+
+    // All filters, to subscribe to them
+    std::vector<std::string> filters() const {
+        std::vector<std::string> result;
+        for (const auto &kv: exact_routes_) {
+            result.push_back(kv.first);
+        }
+        for (const auto &route: wildcard_routes_) {
+            result.push_back(route.filter);
+        }
+        return result;
+    }
+
+    size_t queue_size() const {
+        std::unique_lock<std::mutex> lk(queue_mutex_);
+        return queue_.size();
+    }
+
+private:
+    struct Route {
+        std::string filter;
+        Context context;
+        Handler handler;
+    };
+
+    struct QueuedMessage {
+        const Route *route;
+        std::string topic;
+        Message message;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    void run() {
+        trace_thread_name("inbound_router");
+        while (true) {
+            QueuedMessage queued;
+            {
+                std::unique_lock<std::mutex> lk(queue_mutex_);
+                queue_cv_.wait(lk, [this] { return !queue_.empty() || !running_; });
+                if (!running_)
+                    return;
+                queued = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            if (queue_delay_callback_) {
+                queue_delay_callback_(queued.topic, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - queued.enqueued).count());
+            }
+            queued.route->handler(queued.message);
+        }
+    }
+
+    const size_t max_queue_size_;
+    // Not modified after start(), so lookups don't need a lock
+    std::unordered_map<std::string, Route> exact_routes_;
+    std::vector<Route> wildcard_routes_;
+    QueueDelayCallback queue_delay_callback_;
+
+    mutable std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    std::deque<QueuedMessage> queue_;
+    bool running_ = false;
+    std::thread worker_;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+// The robot side of the bridge, ROS in production.
+// Robot data comes in through the functions in bridge.h, everything the clients send to the robot goes out through this.
+class Ingress {
+public:
+    virtual ~Ingress() = default;
+
+    virtual void send_cmd_vel(double linear_x, double angular_z) = 0;
+
+    virtual void send_action(const std::string &action_id) = 0;
+
+    virtual void send_command(const std::string &command) = 0;
+};
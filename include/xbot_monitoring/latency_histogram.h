@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Log-linear histogram (HDR style): every power of two is split into 16 linear sub-buckets,
+// so each recorded value is accurate to about 6% regardless of its magnitude.
+// record() is lock-free and can be called from any thread.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    struct Snapshot {
+        std::vector<uint64_t> counts;
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t max = 0;
+
+        // Returns the (lower bound of the bucket of the) value below which the given fraction (0..1) of samples fall.
+        uint64_t percentile(double fraction) const {
+            if (count == 0)
+                return 0;
+            const auto target = static_cast<uint64_t>(fraction * static_cast<double>(count - 1));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < counts.size(); i++) {
+                seen += counts[i];
+                if (seen > target)
+                    return bucket_lower_bound(static_cast<int>(i));
+            }
+            return max;
+        }
+
+        double mean() const { return count > 0 ? static_cast<double>(sum) / static_cast<double>(count) : 0.0; }
+    };
+
+    void record(uint64_t value) {
+        counts_[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+        uint64_t current_max = max_.load(std::memory_order_relaxed);
+        while (value > current_max && !max_.compare_exchange_weak(current_max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+    // Not atomic as a whole, but every value is consistent on its own
+    Snapshot snapshot() const {
+        Snapshot snapshot;
+        snapshot.counts.resize(BUCKET_COUNT);
+        for (int i = 0; i < BUCKET_COUNT; i++) {
+            snapshot.counts[i] = counts_[i].load(std::memory_order_relaxed);
+            snapshot.count += snapshot.counts[i];
+        }
+        snapshot.sum = sum_.load(std::memory_order_relaxed);
+        snapshot.max = max_.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    static int bucket_index(uint64_t value) {
+        if (value < SUB_BUCKETS)
+            return static_cast<int>(value);
+        const int msb = 63 - __builtin_clzll(value);
+        const int shift = msb - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKETS + static_cast<int>((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    static uint64_t bucket_lower_bound(int index) {
+        if (index < SUB_BUCKETS)
+            return index;
+        const int shift = index / SUB_BUCKETS - 1;
+        return static_cast<uint64_t>(SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> counts_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
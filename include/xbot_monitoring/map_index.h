@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "xbot_monitoring/geometry.h"
+
+enum class MapPolygonType {
+    WORKING_AREA,
+    NAVIGATION_AREA,
+    OBSTACLE
+};
+
+struct MapPolygon {
+    MapPolygonType type;
+    std::string name;
+    // Index of the area in the map (for obstacles: the area they belong to)
+    int area_index;
+    std::vector<Point2> points;
+    BoundingBox bounds;
+};
+
+// Bounding volume hierarchy over the map's polygons for fast point queries
+class MapIndex {
+public:
+    explicit MapIndex(std::vector<MapPolygon> polygons);
+
+    // Returns all areas and obstacles containing p
+    std::vector<const MapPolygon *> containing(const Point2 &p) const;
+
+    // Finds the obstacle closest to p (0 if p is inside one). Returns nullptr if there is none within max_distance.
+    const MapPolygon *nearest_obstacle(const Point2 &p, double max_distance, double &distance) const;
+
+    const std::vector<MapPolygon> &polygons() const { return polygons_; }
+
+private:
+    struct Node {
+        BoundingBox bounds;
+        // Children for inner nodes, -1 for leafs
+        int left = -1;
+        int right = -1;
+        // Range in order_ for leafs
+        int first = 0;
+        int count = 0;
+    };
+
+    int build(int first, int count);
+
+    std::vector<MapPolygon> polygons_;
+    // Polygon indices, sorted so that each leaf references a contiguous range
+    std::vector<int> order_;
+    std::vector<Node> nodes_;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "xbot_monitoring/geometry.h"
+
+struct TileKey {
+    int x;
+    int y;
+
+    bool operator<(const TileKey &other) const {
+        return x < other.x || (x == other.x && y < other.y);
+    }
+
+    bool operator==(const TileKey &other) const {
+        return x == other.x && y == other.y;
+    }
+};
+
+// Tile keys are clamped to +-TILE_KEY_LIMIT, so that far away (or broken) coordinates can't overflow them
+constexpr int TILE_KEY_LIMIT = 1 << 20;
+// Upper bounds for the tiles of a single polygon and of a whole map, to keep outliers or a tiny tile size
+// from tying up the callback thread
+constexpr size_t MAX_TILES_PER_POLYGON = 1024;
+constexpr size_t MAX_TILES_PER_MAP = 4096;
+
+// Fixed grid of square tiles, tile (0, 0) starts at the origin
+class TileGrid {
+public:
+    explicit TileGrid(double tile_size) : tile_size_(tile_size) {
+    }
+
+    // p has to be finite
+    TileKey key(const Point2 &p) const;
+
+    BoundingBox tile_bounds(const TileKey &key) const;
+
+    // Number of tiles overlapping the bounds
+    size_t tile_count(const BoundingBox &bounds) const;
+
+    // All tiles overlapping the bounds, check tile_count() first
+    std::vector<TileKey> tiles(const BoundingBox &bounds) const;
+
+    double tile_size() const { return tile_size_; }
+
+private:
+    const double tile_size_;
+};
+
+// The points without NaN or infinite coordinates
+std::vector<Point2> finite_points(const std::vector<Point2> &points);
+
+// Clips a closed polygon to the box (Sutherland-Hodgman). The result is empty if they don't overlap.
+std::vector<Point2> clip_polygon(const std::vector<Point2> &polygon, const BoundingBox &box);
+
+// Clips an open polyline to the box, which can split it into multiple pieces.
+std::vector<std::vector<Point2>> clip_polyline(const std::vector<Point2> &polyline, const BoundingBox &box);
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "xbot_monitoring/latency_histogram.h"
+
+enum class MetricCounter : int {
+    MESSAGES_IN,
+    BYTES_IN,
+    MESSAGES_OUT,
+    BYTES_OUT,
+    // Kept in the offline buffer instead of publishing
+    BUFFERED,
+    DROPS,
+    EXCEPTIONS,
+    COUNT
+};
+
+enum class MetricTiming : int {
+    // Serialization time in ns
+    ENCODE,
+    // Time between receiving and handling a message in ns
+    QUEUE_DELAY,
+    COUNT
+};
+
+// Counters and timing histograms per topic family (the first level of the topic, e.g. "sensors").
+// Counters are written to per-thread shards without atomic read-modify-write operations,
+// histograms are shared but lock-free. Only registering families and taking snapshots lock.
+class MetricsRegistry {
+public:
+    static constexpr int MAX_FAMILIES = 64;
+    static constexpr int COUNTER_COUNT = static_cast<int>(MetricCounter::COUNT);
+    static constexpr int TIMING_COUNT = static_cast<int>(MetricTiming::COUNT);
+
+    struct FamilySnapshot {
+        std::string name;
+        uint64_t counters[COUNTER_COUNT];
+        LatencyHistogram::Snapshot timings[TIMING_COUNT];
+    };
+
+    MetricsRegistry();
+
+    // Returns the id of the family, registering it if needed. This takes a lock, so keep the id.
+    // If there are too many families, the rest is counted as "other".
+    int family(const std::string &name);
+
+    // Returns the family of a topic. Cached per thread, so this only locks for topics the thread hasn't seen yet.
+    int topic_family(const std::string &topic);
+
+    void add(int family, MetricCounter counter, uint64_t value = 1);
+
+    void record(int family, MetricTiming timing, uint64_t ns);
+
+    std::vector<FamilySnapshot> snapshot() const;
+
+private:
+    struct Shard {
+        std::atomic<uint64_t> counters[MAX_FAMILIES][COUNTER_COUNT];
+    };
+
+    Shard &local_shard();
+
+    mutable std::mutex mutex_;
+    std::vector<std::string> families_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    // Allocated when the family is registered, so reading them without the lock is fine afterwards
+    std::unique_ptr<LatencyHistogram> timings_[MAX_FAMILIES][TIMING_COUNT];
+};
+
+// The process wide registry
+MetricsRegistry &metrics();
+
+// snake_case names used for publishing, e.g. "messages_in"
+const char *metric_name(MetricCounter counter);
+const char *metric_name(MetricTiming timing);
+
+// Formats a snapshot in the Prometheus text exposition format (version 0.0.4).
+// Counters become xbot_monitoring_<name>_total, timings become summaries in seconds.
+std::string prometheus_text(const std::vector<MetricsRegistry::FamilySnapshot> &snapshot);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+// Minimal HTTP server answering GET /metrics with the text returned by the body callback.
+// Runs on its own thread and handles one connection at a time, which is plenty for a scraper.
+class MetricsHttpServer {
+public:
+    using BodyCallback = std::function<std::string()>;
+
+    ~MetricsHttpServer();
+
+    // Binds and starts serving. Returns false if the socket can't be bound.
+    bool start(const std::string &address, int port, BodyCallback body);
+
+    void stop();
+
+private:
+    void run();
+
+    void handle(int connection);
+
+    int socket_ = -1;
+    std::atomic<bool> running_{false};
+    BodyCallback body_;
+    std::thread thread_;
+};
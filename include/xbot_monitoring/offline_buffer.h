@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+
+struct BufferedMessage {
+    std::string topic;
+    std::string payload;
+};
+
+// Bounded buffer for messages which could not be published while the broker was unreachable.
+class OfflineBuffer {
+public:
+    enum class Mode {
+        // Keep every message and replay them in order
+        ORDERED,
+        // Only keep the latest message per topic
+        LATEST
+    };
+
+    // If spill_path is not empty, ORDERED buffers move the oldest messages into that file
+    // once max_bytes is exceeded. The file never grows beyond max_spill_bytes.
+    OfflineBuffer(Mode mode, size_t max_bytes, std::string spill_path = "", size_t max_spill_bytes = 0);
+    ~OfflineBuffer();
+
+    void push(const std::string &topic, const void *data, size_t size);
+
+    // Gets the oldest buffered message, returns false if the buffer is empty.
+    bool pop(BufferedMessage &out);
+
+    bool empty() const;
+    size_t size() const;
+    uint64_t dropped() const;
+
+private:
+    bool spill_oldest();
+    // Moves the unread part of the spill file to its start
+    bool compact_spill_file();
+    bool read_spilled(BufferedMessage &out);
+
+    const Mode mode_;
+    const size_t max_bytes_;
+    const std::string spill_path_;
+    const size_t max_spill_bytes_;
+
+    mutable std::mutex mutex_;
+    std::deque<BufferedMessage> messages_;
+    std::map<std::string, std::string> latest_;
+    size_t bytes_ = 0;
+    uint64_t dropped_ = 0;
+
+    FILE *spill_file_ = nullptr;
+    long spill_read_offset_ = 0;
+    long spill_write_offset_ = 0;
+    size_t spilled_count_ = 0;
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+struct ProcessStats {
+    // user + system time in seconds
+    double cpu_time = 0.0;
+    uint64_t rss_bytes = 0;
+    int threads = 0;
+};
+
+// Reads the stats of the current process from /proc. Returns false if /proc isn't available.
+bool read_process_stats(ProcessStats &stats);
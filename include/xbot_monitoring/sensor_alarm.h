@@ -0,0 +1,50 @@
+#pragma once
+
+enum class AlarmState {
+    NONE,
+    LOW,
+    HIGH
+};
+
+struct AlarmLimits {
+    bool has_critical_low = false;
+    double lower_critical_value = 0;
+    bool has_critical_high = false;
+    double upper_critical_value = 0;
+    // A raised alarm is only cleared once the value is back inside the limits by this margin
+    double hysteresis = 0;
+};
+
+// Threshold alarm for a single sensor
+class SensorAlarm {
+public:
+    explicit SensorAlarm(const AlarmLimits &limits) : limits_(limits) {
+    }
+
+    // Evaluates a new sample, returns true if the alarm state changed.
+    bool update(double value) {
+        AlarmState next = state_;
+        if (limits_.has_critical_high && value > limits_.upper_critical_value) {
+            next = AlarmState::HIGH;
+        } else if (limits_.has_critical_low && value < limits_.lower_critical_value) {
+            next = AlarmState::LOW;
+        } else if (state_ == AlarmState::HIGH && value < limits_.upper_critical_value - limits_.hysteresis) {
+            next = AlarmState::NONE;
+        } else if (state_ == AlarmState::LOW && value > limits_.lower_critical_value + limits_.hysteresis) {
+            next = AlarmState::NONE;
+        }
+
+        if (next == state_)
+            return false;
+        state_ = next;
+        return true;
+    }
+
+    AlarmState state() const { return state_; }
+
+    const AlarmLimits &limits() const { return limits_; }
+
+private:
+    const AlarmLimits limits_;
+    AlarmState state_ = AlarmState::NONE;
+};
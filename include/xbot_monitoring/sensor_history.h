@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+struct HistorySample {
+    double stamp;
+    double value;
+};
+
+// Samples kept per sensor at most, 16 MB per sensor
+constexpr size_t SENSOR_HISTORY_MAX_CAPACITY = size_t(1) << 20;
+
+// Fixed-size ring buffer of (stamp, value) samples for a single double sensor.
+// Samples are stored contiguously so queries are a linear walk over memory.
+class SensorHistory {
+public:
+    // The capacity is clamped to [1, SENSOR_HISTORY_MAX_CAPACITY] and rounded up to the next power of two.
+    explicit SensorHistory(size_t capacity);
+
+    void push(double stamp, double value);
+
+    // Returns samples with stamp >= since (oldest first).
+    // If max_points is non-zero and there are more samples, they are averaged into max_points buckets.
+    std::vector<HistorySample> query(double since, size_t max_points) const;
+
+    size_t size() const;
+
+private:
+    std::vector<HistorySample> samples_;
+    size_t mask_;
+    // Index of the next sample to write (monotonically increasing, wrapped via mask_)
+    size_t head_ = 0;
+    size_t count_ = 0;
+    mutable std::mutex mutex_;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+// Synthetic messages shared by the load generator, the throughput harness and the encoding benchmarks.
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+#include "ros/time.h"
+#include "geometry_msgs/Polygon.h"
+#include "xbot_msgs/Map.h"
+#include "xbot_msgs/MapOverlay.h"
+#include "xbot_msgs/RobotState.h"
+
+// A circle with the given number of points
+inline geometry_msgs::Polygon make_polygon(double cx, double cy, double radius, int points) {
+    geometry_msgs::Polygon polygon;
+    for (int i = 0; i < points; i++) {
+        const double angle = 2.0 * M_PI * i / points;
+        geometry_msgs::Point32 pt;
+        pt.x = static_cast<float>(cx + radius * std::cos(angle));
+        pt.y = static_cast<float>(cy + radius * std::sin(angle));
+        polygon.points.push_back(pt);
+    }
+    return polygon;
+}
+
+// areas working areas in a row, each with obstacles obstacles, and one navigation area around them.
+// Every polygon has points points.
+inline xbot_msgs::Map make_map(int areas, int obstacles, int points) {
+    xbot_msgs::Map map;
+    const double spacing = 20.0;
+    map.mapWidth = areas * spacing;
+    map.mapHeight = spacing;
+    map.mapCenterX = (areas - 1) * spacing / 2.0;
+    for (int i = 0; i < areas; i++) {
+        xbot_msgs::MapArea area;
+        area.name = "area_" + std::to_string(i);
+        area.area = make_polygon(i * spacing, 0.0, 8.0, points);
+        for (int o = 0; o < obstacles; o++) {
+            const double angle = 2.0 * M_PI * o / obstacles;
+            area.obstacles.push_back(make_polygon(i * spacing + 4.0 * std::cos(angle), 4.0 * std::sin(angle), 1.0, points));
+        }
+        map.workingArea.push_back(area);
+    }
+    xbot_msgs::MapArea navigation;
+    navigation.name = "navigation";
+    navigation.area = make_polygon(map.mapCenterX, 0.0, map.mapWidth / 2.0 + 5.0, points);
+    map.navigationAreas.push_back(navigation);
+    return map;
+}
+
+// Moves a bit with seq, so that consecutive overlays differ
+inline xbot_msgs::MapOverlay make_map_overlay(int polygons, int points, uint64_t seq) {
+    xbot_msgs::MapOverlay overlay;
+    for (int i = 0; i < polygons; i++) {
+        xbot_msgs::MapOverlayPolygon poly;
+        poly.polygon = make_polygon(i * 5.0 + (seq % 10) * 0.1, 0.0, 2.0, points);
+        poly.closed = i % 2 == 0;
+        poly.line_width = 0.1;
+        poly.color = "#00ff00";
+        overlay.polygons.push_back(poly);
+    }
+    return overlay;
+}
+
+// The robot t seconds into driving on a circle around the origin
+inline xbot_msgs::RobotState make_robot_state(double t, const ros::Time &stamp = ros::Time()) {
+    xbot_msgs::RobotState state;
+    state.battery_percentage = static_cast<float>(0.5 + 0.5 * std::sin(t / 600.0));
+    state.gps_percentage = 1.0f;
+    state.current_state = "MOWING";
+    state.current_sub_state = "PATH";
+    state.current_action_progress = static_cast<float>(std::fmod(t / 600.0, 1.0));
+    state.robot_pose.header.stamp = stamp;
+    state.robot_pose.pose.pose.position.x = 10.0 * std::cos(t / 10.0);
+    state.robot_pose.pose.pose.position.y = 10.0 * std::sin(t / 10.0);
+    state.robot_pose.vehicle_heading = std::fmod(t / 10.0 + M_PI / 2.0, 2.0 * M_PI);
+    state.robot_pose.position_accuracy = 0.02f;
+    state.robot_pose.orientation_accuracy = 0.01f;
+    state.robot_pose.orientation_valid = true;
+    return state;
+}
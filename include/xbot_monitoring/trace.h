@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Span recording for the hot paths, compiled in with -DXBOT_TRACE=ON.
+// Each thread records into its own ring buffer, trace_dump() writes the most recent spans of all threads
+// in the Chrome trace format (load it in chrome://tracing or https://ui.perfetto.dev).
+// Without XBOT_TRACE the macros compile to nothing.
+
+#ifdef XBOT_TRACE
+
+// Spans kept per thread, older ones are overwritten
+constexpr size_t TRACE_BUFFER_SIZE = 16384;
+
+class TraceScope {
+public:
+    // name has to outlive the trace, use string literals
+    explicit TraceScope(const char *name);
+
+    ~TraceScope();
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *name_;
+    uint64_t start_ns_;
+};
+
+#define XBOT_TRACE_CONCAT_(a, b) a##b
+#define XBOT_TRACE_CONCAT(a, b) XBOT_TRACE_CONCAT_(a, b)
+#define XBOT_TRACE_SCOPE(name) TraceScope XBOT_TRACE_CONCAT(xbot_trace_scope_, __COUNTER__)(name)
+
+// Names the calling thread in the dump
+void trace_thread_name(const char *name);
+
+#else
+
+#define XBOT_TRACE_SCOPE(name) do {} while (0)
+
+inline void trace_thread_name(const char *) {}
+
+#endif
+
+constexpr bool trace_enabled() {
+#ifdef XBOT_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Locks the mutex, recording the time spent waiting as a span
+template<typename Mutex>
+std::unique_lock<Mutex> trace_lock(Mutex &mutex, const char *name) {
+    XBOT_TRACE_SCOPE(name);
+    return std::unique_lock<Mutex>(mutex);
+}
+
+// Writes the recorded spans to path. Returns false if tracing is compiled out or the file can't be written.
+bool trace_dump(const std::string &path);
+
+// Async signal safe, makes trace_dump_requested() return true once.
+void trace_request_dump();
+
+bool trace_dump_requested();
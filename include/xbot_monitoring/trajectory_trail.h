@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+struct TrailPoint {
+    double stamp;
+    double x;
+    double y;
+    double heading;
+    uint32_t seq;
+};
+
+// Bounded trail of recent robot poses. A pose is only added if the robot moved or turned enough since the last point.
+class TrajectoryTrail {
+public:
+    TrajectoryTrail(double min_distance, double min_angle, double max_age, size_t max_points);
+
+    // Returns true if the pose was added to the trail.
+    bool add(double stamp, double x, double y, double heading);
+
+    // Drops points older than max_age at stamp, also while no poses are added. Returns true if points were dropped.
+    bool prune(double stamp);
+
+    const std::deque<TrailPoint> &points() const { return points_; }
+
+    // Sequence number of the newest point
+    uint32_t last_seq() const { return next_seq_ - 1; }
+
+private:
+    const double min_distance_;
+    const double min_angle_;
+    const double max_age_;
+    const size_t max_points_;
+
+    std::deque<TrailPoint> points_;
+    uint32_t next_seq_ = 1;
+};
@@ -0,0 +1,1607 @@
+//
+// Created by Clemens Elflein on 22.11.22.
+// Copyright (c) 2022 Clemens Elflein. All rights reserved.
+//
+#include "xbot_monitoring/bridge.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+
+#include "ros/console.h"
+#include <nlohmann/json.hpp>
+#include "xbot_monitoring/sensor_history.h"
+#include "xbot_monitoring/history_log.h"
+#include "xbot_monitoring/offline_buffer.h"
+#include "xbot_monitoring/sensor_alarm.h"
+#include "xbot_monitoring/binary_writer.h"
+#include "xbot_monitoring/trajectory_trail.h"
+#include "xbot_monitoring/map_index.h"
+#include "xbot_monitoring/map_tiles.h"
+#include "xbot_monitoring/bson_scanner.h"
+#include "xbot_monitoring/bson_writer.h"
+#include "xbot_monitoring/latency_histogram.h"
+#include "xbot_monitoring/inbound_router.h"
+#include "xbot_monitoring/metrics.h"
+#include "xbot_monitoring/process_stats.h"
+#include "xbot_monitoring/trace.h"
+#include "xbot_monitoring/encoding.h"
+
+using json = nlohmann::json;
+
+void publish_sensor_metadata();
+void publish_map(bool changed_tiles_only = false);
+void publish_map_overlay(bool changed_tiles_only = false);
+void publish_actions();
+void publish_alarms();
+void publish_robot_status();
+void publish_trail();
+void publish_robot_area();
+void handle_history_request(const InboundMessagePtr &msg);
+void handle_teleop(const InboundMessagePtr &msg);
+void handle_action(const InboundMessagePtr &msg);
+void handle_command(const InboundMessagePtr &msg);
+
+BridgeConfig config;
+Egress *egress = nullptr;
+Ingress *ingress = nullptr;
+
+// Stores registered actions (prefix to vector<action>)
+std::map<std::string, std::vector<xbot_msgs::ActionInfo>> registered_actions;
+// Full action id (prefix/action_id) to enabled flag, for validating inbound actions
+std::unordered_map<std::string, bool> action_index;
+std::mutex actions_mutex;
+
+// Latencies of each sensor in us (sensor_id to latency)
+struct SensorLatency {
+    // From the stamp of the message to receiving it in the bridge, only for stamped messages
+    LatencyHistogram sensor_to_bridge;
+    // From receiving the message to handing it to the MQTT client
+    LatencyHistogram bridge_to_publish;
+};
+std::map<std::string, std::shared_ptr<SensorLatency>> sensor_latencies;
+std::mutex sensor_latencies_mutex;
+
+// Everything needed to publish the values of a sensor
+struct Sensor {
+    xbot_msgs::SensorInfo info;
+    // Only for double sensors
+    std::shared_ptr<SensorHistory> history;
+    std::shared_ptr<SensorAlarm> alarm;
+    std::shared_ptr<SensorLatency> latency;
+    uint16_t log_channel = 0;
+    // False for quantities none of the SensorInfo descriptions fit, their info's value_description is meaningless
+    bool has_value_description = true;
+};
+
+// Maps the info topic to the sensor
+std::map<std::string, std::unique_ptr<Sensor>> found_sensors;
+
+// Recent samples for each double sensor (sensor_id to history)
+std::map<std::string, std::shared_ptr<SensorHistory>> sensor_histories;
+std::mutex sensor_histories_mutex;
+
+// Optional persistent log of sensor data and robot state, nullptr if disabled
+std::unique_ptr<HistoryLog> history_log;
+
+// Buffers messages while the broker is unreachable, nullptr if disabled
+std::unique_ptr<OfflineBuffer> offline_buffer;
+std::mutex offline_replay_mutex;
+std::condition_variable offline_replay_cv;
+// Set by the connection callbacks, replay additionally checks the egress itself
+bool mqtt_connected = false;
+std::thread offline_replay_thread;
+// Live messages are never buffered while connected. Instead, topics published live while older messages are still
+// waiting for replay are remembered, and those older messages are skipped, so that every topic ends on its newest value.
+std::mutex offline_live_mutex;
+std::set<std::string> offline_live_topics;
+// Set while the replay thread holds a message it has taken from the buffer but not published yet
+bool offline_replay_pending = false;
+// A replayed message is dropped after failing this often
+const int OFFLINE_REPLAY_MAX_ATTEMPTS = 5;
+std::atomic<bool> bridge_running{false};
+
+// Currently raised alarms (sensor_id to alarm info)
+std::map<std::string, json> active_alarms;
+std::mutex alarms_mutex;
+
+// Last full robot_state if robot_state_delta is enabled
+json robot_state_keyframe;
+ros::Time robot_state_keyframe_time;
+uint32_t robot_state_keyframe_seq = 0;
+
+uint16_t robot_pose_seq = 0;
+json robot_status;
+std::mutex robot_status_mutex;
+
+// Recent path of the robot, nullptr if disabled
+std::unique_ptr<TrajectoryTrail> trail;
+std::mutex trail_mutex;
+ros::Time trail_last_publish;
+// The trail changed since the last full publish
+bool trail_changed = false;
+
+// Spatial index over the current map, replaced as a whole when a new map arrives
+std::shared_ptr<const MapIndex> map_index;
+// The robot's current area and obstacle proximity
+json robot_area;
+std::mutex robot_area_mutex;
+
+std::mutex mqtt_callback_mutex;
+
+// Handlers for inbound MQTT messages, the router's filters are subscribed on connect
+InboundRouter<InboundMessagePtr> inbound_router;
+
+// Teleop session: a zero twist is sent if no command arrived for teleop_timeout seconds.
+// Commands with a seq not newer than the last one of their session, or a timestamp older than teleop_max_age seconds,
+// are dropped. The seq only restarts with a new session id.
+std::mutex teleop_mutex;
+std::chrono::steady_clock::time_point teleop_last_command;
+// True if the robot might still move due to the last command
+bool teleop_active = false;
+bool teleop_has_seq = false;
+int64_t teleop_last_seq = 0;
+bool teleop_has_session = false;
+int64_t teleop_session = 0;
+// Client to bridge delay (needs synchronized clocks) and time spent in handle_teleop, both in microseconds
+LatencyHistogram teleop_inbound_delay;
+LatencyHistogram teleop_processing_time;
+
+// Map state, written by the map callbacks and read by publish_map() and publish_map_overlay() on connect
+std::mutex map_mutex;
+json map;
+json map_overlay;
+// Bounds, area, perimeter etc. of the map's polygons
+json map_summary;
+bool has_map = false;
+bool has_map_overlay = false;
+
+// Map and overlay split into tiles
+std::map<TileKey, json> map_tiles;
+std::map<TileKey, json> map_overlay_tiles;
+// Hashes of the tiles which are currently retained on the broker, so that we can skip unchanged tiles and clear the
+// ones which disappear
+std::map<TileKey, size_t> published_map_tiles;
+std::map<TileKey, size_t> published_map_overlay_tiles;
+
+bool offline_buffered_topic(const std::string &topic) {
+    if (!offline_buffer)
+        return false;
+    for (const auto &prefix: config.offline_buffer_topics) {
+        if (topic.compare(0, prefix.size(), prefix) == 0)
+            return true;
+    }
+    return false;
+}
+
+void buffer_offline(const std::string &topic, const void *data, size_t size) {
+    std::unique_lock<std::mutex> lk(offline_live_mutex);
+    offline_buffer->push(topic, data, size);
+    // This message is newer than the live one, so the older buffered ones may be replayed before it again
+    offline_live_topics.erase(topic);
+}
+
+// Called before publishing a message on a buffered topic live
+void supersede_offline(const std::string &topic) {
+    std::unique_lock<std::mutex> lk(offline_live_mutex);
+    if (offline_replay_pending || !offline_buffer->empty())
+        offline_live_topics.insert(topic);
+}
+
+void try_publish_binary(std::string topic, const void *data, size_t size, bool retain = false) {
+    XBOT_TRACE_SCOPE("publish");
+    const int family = metrics().topic_family(topic);
+    // Retained data is published again on connect anyway, so only live data needs buffering.
+    const bool buffered_topic = !retain && offline_buffered_topic(topic);
+    if (buffered_topic) {
+        if (!egress->is_connected()) {
+            buffer_offline(topic, data, size);
+            metrics().add(family, MetricCounter::BUFFERED);
+            return;
+        }
+        supersede_offline(topic);
+    }
+    if (egress->publish(topic, data, size, retain)) {
+        metrics().add(family, MetricCounter::MESSAGES_OUT);
+        metrics().add(family, MetricCounter::BYTES_OUT, size);
+    } else {
+        // client disconnected or something, keep it for later or drop it.
+        metrics().add(family, MetricCounter::EXCEPTIONS);
+        if (buffered_topic) {
+            buffer_offline(topic, data, size);
+            metrics().add(family, MetricCounter::BUFFERED);
+        } else {
+            metrics().add(family, MetricCounter::DROPS);
+        }
+    }
+}
+
+void try_publish(std::string topic, std::string data, bool retain = false) {
+    try_publish_binary(std::move(topic), data.data(), data.size(), retain);
+}
+
+void publish_json(const std::string &topic, const json &j, bool retain = false) {
+    const auto start = std::chrono::steady_clock::now();
+    std::string data;
+    {
+        XBOT_TRACE_SCOPE("encode json");
+        data = j.dump();
+    }
+    metrics().record(metrics().topic_family(topic), MetricTiming::ENCODE,
+                     std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    try_publish(topic, std::move(data), retain);
+}
+
+void publish_bson(const std::string &topic, const json &j, bool retain = false) {
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> bson;
+    {
+        XBOT_TRACE_SCOPE("encode bson");
+        bson = json::to_bson(j);
+    }
+    metrics().record(metrics().topic_family(topic), MetricTiming::ENCODE,
+                     std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    try_publish_binary(topic, bson.data(), bson.size(), retain);
+}
+
+// Publishes j on <topic>/json and as {"d": j} on <topic>/bson
+void publish_json_bson(const std::string &topic, const json &j, bool retain = false) {
+    publish_json(topic + "/json", j, retain);
+    json data;
+    data["d"] = j;
+    publish_bson(topic + "/bson", data, retain);
+}
+
+// Publishes buffered messages after a reconnect, throttled so that live data still gets through.
+void replay_offline_buffer() {
+    trace_thread_name("offline_replay");
+    const auto interval = std::chrono::duration<double>(1.0 / config.offline_buffer_replay_rate);
+    BufferedMessage msg;
+    int attempts = 0;
+    while (bridge_running) {
+        {
+            std::unique_lock<std::mutex> lk(offline_replay_mutex);
+            offline_replay_cv.wait_for(lk, std::chrono::seconds(1), [] { return mqtt_connected || !bridge_running; });
+            if (!mqtt_connected)
+                continue;
+        }
+        if (!egress->is_connected()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+
+        bool published;
+        {
+            // Held while publishing, so that a live message on the same topic can't overtake the check
+            std::unique_lock<std::mutex> lk(offline_live_mutex);
+            if (!offline_replay_pending) {
+                if (!offline_buffer->pop(msg)) {
+                    offline_live_topics.clear();
+                    lk.unlock();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    continue;
+                }
+                offline_replay_pending = true;
+                attempts = 0;
+            }
+            if (offline_live_topics.count(msg.topic) != 0) {
+                // Already superseded by a live message
+                offline_replay_pending = false;
+                continue;
+            }
+            published = egress->publish(msg.topic, msg.payload.data(), msg.payload.size(), false);
+            if (published || ++attempts >= OFFLINE_REPLAY_MAX_ATTEMPTS)
+                offline_replay_pending = false;
+        }
+
+        const int family = metrics().topic_family(msg.topic);
+        if (published) {
+            metrics().add(family, MetricCounter::MESSAGES_OUT);
+            metrics().add(family, MetricCounter::BYTES_OUT, msg.payload.size());
+            std::this_thread::sleep_for(interval);
+        } else if (attempts >= OFFLINE_REPLAY_MAX_ATTEMPTS) {
+            metrics().add(family, MetricCounter::DROPS);
+            ROS_WARN_STREAM_THROTTLE(1.0, "Dropping buffered message on " << msg.topic << " after "
+                                          << attempts << " failed attempts");
+        } else {
+            // Keep the message and retry with backoff
+            std::this_thread::sleep_for(interval * (1 << attempts));
+        }
+    }
+}
+
+// Decides whether a teleop command is executed. The caller holds no locks.
+bool accept_teleop(double vx, double vz, bool has_session, int64_t session, bool has_seq, int64_t seq, bool has_stamp,
+                   int64_t stamp_ms, int64_t now_ms) {
+    if (config.teleop_max_age > 0 && has_stamp && now_ms - stamp_ms > config.teleop_max_age * 1000.0) {
+        ROS_WARN_STREAM_THROTTLE(1.0, "Dropping stale teleop command (" << now_ms - stamp_ms << " ms old)");
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lk(teleop_mutex);
+    // A restarted client announces itself with a new session id, only then the seq may go back.
+    // A timeout doesn't reset it, otherwise commands queued during a link stall would move the robot again.
+    if (has_session && (!teleop_has_session || session != teleop_session)) {
+        teleop_has_session = true;
+        teleop_session = session;
+        teleop_has_seq = false;
+    }
+    if (has_seq && teleop_has_seq && seq <= teleop_last_seq) {
+        ROS_WARN_STREAM_THROTTLE(1.0, "Dropping out of order teleop command " << seq << " (last: " << teleop_last_seq << ")");
+        return false;
+    }
+    // Unsequenced commands leave the seq alone, so they can't open the door for older sequenced ones
+    if (has_seq) {
+        teleop_has_seq = true;
+        teleop_last_seq = seq;
+    }
+    teleop_last_command = std::chrono::steady_clock::now();
+    teleop_active = vx != 0.0 || vz != 0.0;
+    return true;
+}
+
+void handle_teleop(const InboundMessagePtr &msg) {
+    XBOT_TRACE_SCOPE("handle_teleop");
+    const auto start = std::chrono::steady_clock::now();
+    const int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+    // Hot path: read the fields straight from the buffer instead of decoding the whole document
+    const auto &payload = msg->payload;
+    BsonScanner bson(payload.data(), payload.size());
+    double vx, vz;
+    if (!bson.get_double("vx", vx) || !bson.get_double("vz", vz)) {
+        ROS_ERROR_STREAM_THROTTLE(1.0, "Error decoding /teleop bson: vx and vz are required");
+        return;
+    }
+
+    int64_t session = 0, seq = 0, stamp_ms = 0;
+    const bool has_session = bson.get_int64("s", session);
+    const bool has_seq = bson.get_int64("seq", seq);
+    const bool has_stamp = bson.get_int64("t", stamp_ms);
+    if (has_stamp && now_ms >= stamp_ms) {
+        teleop_inbound_delay.record(static_cast<uint64_t>(now_ms - stamp_ms) * 1000);
+    }
+
+    const bool accepted = accept_teleop(vx, vz, has_session, session, has_seq, seq, has_stamp, stamp_ms, now_ms);
+    if (accepted) {
+        ROS_INFO_STREAM_THROTTLE(0.5,"vx:" << vx << " vr: " << vz);
+        ingress->send_cmd_vel(vx, vz);
+    }
+
+    const auto processing_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    teleop_processing_time.record(static_cast<uint64_t>(processing_us));
+
+    // Echo, so that the client can measure the round trip
+    if (has_seq || has_stamp) {
+        BsonWriter ack;
+        if (has_seq)
+            ack.add_int64("seq", seq);
+        if (has_stamp)
+            ack.add_int64("t", stamp_ms);
+        ack.add_int64("rx", now_ms);
+        ack.add_int64("proc_us", processing_us);
+        ack.add_bool("accepted", accepted);
+        const auto &bson_ack = ack.finish();
+        try_publish_binary("teleop/ack/bson", bson_ack.data(), bson_ack.size());
+    }
+}
+
+void publish_action_result(const std::string &action_id, bool accepted, const std::string &reason) {
+    json result;
+    result["action_id"] = action_id;
+    result["accepted"] = accepted;
+    result["reason"] = reason;
+    publish_json_bson("action/result", result);
+}
+
+void handle_action(const InboundMessagePtr &msg) {
+    XBOT_TRACE_SCOPE("handle_action");
+    const std::string &action_id = msg->payload;
+    ROS_INFO_STREAM("Got action: " + action_id);
+
+    // Reject unknown and disabled actions right away instead of letting the state machine do it
+    std::string reason;
+    {
+        std::unique_lock<std::mutex> lk(actions_mutex);
+        auto it = action_index.find(action_id);
+        if (it == action_index.end()) {
+            reason = "unknown";
+        } else if (!it->second) {
+            reason = "disabled";
+        }
+    }
+    if (!reason.empty()) {
+        ROS_WARN_STREAM("Rejected " << reason << " action: " << action_id);
+        publish_action_result(action_id, false, reason);
+        return;
+    }
+
+    ingress->send_action(action_id);
+    publish_action_result(action_id, true, "");
+}
+
+void handle_command(const InboundMessagePtr &msg) {
+    XBOT_TRACE_SCOPE("handle_command");
+    ROS_INFO_STREAM("Got command: " + msg->payload);
+    ingress->send_command(msg->payload);
+}
+
+json histogram_summary(const LatencyHistogram &histogram) {
+    const auto snapshot = histogram.snapshot();
+    json j;
+    j["count"] = snapshot.count;
+    j["mean"] = snapshot.mean();
+    j["p50"] = snapshot.percentile(0.5);
+    j["p90"] = snapshot.percentile(0.9);
+    j["p99"] = snapshot.percentile(0.99);
+    j["max"] = snapshot.max;
+    return j;
+}
+
+void publish_teleop_latency() {
+    static uint64_t last_count = 0;
+    const uint64_t count = teleop_processing_time.count();
+    if (count == last_count)
+        return;
+    last_count = count;
+
+    json j;
+    j["inbound_delay_us"] = histogram_summary(teleop_inbound_delay);
+    j["processing_time_us"] = histogram_summary(teleop_processing_time);
+    publish_json_bson("teleop/latency", j);
+}
+
+void publish_sensor_latency() {
+    json j = json::object();
+    {
+        std::unique_lock<std::mutex> lk(sensor_latencies_mutex);
+        for (const auto &kv: sensor_latencies) {
+            if (kv.second->bridge_to_publish.count() == 0)
+                continue;
+            json &sensor = j[kv.first];
+            sensor["sensor_to_bridge_us"] = histogram_summary(kv.second->sensor_to_bridge);
+            sensor["bridge_to_publish_us"] = histogram_summary(kv.second->bridge_to_publish);
+        }
+    }
+    if (!j.empty()) {
+        publish_json_bson("sensor_latency", j);
+    }
+}
+
+void publish_metrics() {
+    XBOT_TRACE_SCOPE("publish_metrics");
+    json j;
+    for (const auto &family: metrics().snapshot()) {
+        json &f = j[family.name];
+        for (int c = 0; c < MetricsRegistry::COUNTER_COUNT; c++) {
+            f[metric_name(static_cast<MetricCounter>(c))] = family.counters[c];
+        }
+        for (int t = 0; t < MetricsRegistry::TIMING_COUNT; t++) {
+            const auto &timing = family.timings[t];
+            if (timing.count == 0)
+                continue;
+            json &summary = f[std::string(metric_name(static_cast<MetricTiming>(t))) + "_ns"];
+            summary["count"] = timing.count;
+            summary["mean"] = timing.mean();
+            summary["p50"] = timing.percentile(0.5);
+            summary["p90"] = timing.percentile(0.9);
+            summary["p99"] = timing.percentile(0.99);
+            summary["max"] = timing.max;
+        }
+    }
+    publish_json_bson("xbot_monitoring/metrics", j);
+}
+
+void publish_sensor_metadata() {
+    XBOT_TRACE_SCOPE("publish_sensor_metadata");
+    auto lk = trace_lock(mqtt_callback_mutex, "wait mqtt_callback_mutex");
+
+    if(found_sensors.empty())
+        return;
+
+    json sensor_info;
+    for (const auto &kv: found_sensors) {
+        json info = sensor_info_to_json(kv.second->info);
+        if (!kv.second->has_value_description)
+            info["value_description"] = "UNKNOWN";
+        sensor_info.push_back(std::move(info));
+    }
+    publish_json_bson("sensor_infos", sensor_info, true);
+}
+
+const char *alarm_state_name(AlarmState state) {
+    switch (state) {
+        case AlarmState::LOW:
+            return "LOW";
+        case AlarmState::HIGH:
+            return "HIGH";
+        default:
+            return "NONE";
+    }
+}
+
+std::shared_ptr<SensorAlarm> create_sensor_alarm(const xbot_msgs::SensorInfo &info) {
+    if (!info.has_critical_low && !info.has_critical_high)
+        return nullptr;
+
+    AlarmLimits limits;
+    limits.has_critical_low = info.has_critical_low;
+    limits.lower_critical_value = info.lower_critical_value;
+    limits.has_critical_high = info.has_critical_high;
+    limits.upper_critical_value = info.upper_critical_value;
+
+    double range;
+    if (info.has_min_max) {
+        range = info.max_value - info.min_value;
+    } else if (info.has_critical_low && info.has_critical_high) {
+        range = info.upper_critical_value - info.lower_critical_value;
+    } else {
+        range = std::abs(info.has_critical_low ? info.lower_critical_value : info.upper_critical_value);
+    }
+    limits.hysteresis = std::abs(range) * config.alarm_hysteresis;
+    return std::make_shared<SensorAlarm>(limits);
+}
+
+void publish_alarms() {
+    json alarms = json::array();
+    {
+        std::unique_lock<std::mutex> lk(alarms_mutex);
+        for (const auto &kv: active_alarms) {
+            alarms.push_back(kv.second);
+        }
+    }
+
+    publish_json_bson("alarms", alarms, true);
+}
+
+void update_sensor_alarm(const xbot_msgs::SensorInfo &info, SensorAlarm &alarm, double value, const ros::Time &stamp) {
+    if (!alarm.update(value))
+        return;
+
+    json event;
+    event["sensor_id"] = info.sensor_id;
+    event["sensor_name"] = info.sensor_name;
+    event["state"] = alarm_state_name(alarm.state());
+    event["value"] = value;
+    event["stamp"] = stamp.toSec();
+    if (alarm.state() == AlarmState::LOW) {
+        event["threshold"] = alarm.limits().lower_critical_value;
+    } else if (alarm.state() == AlarmState::HIGH) {
+        event["threshold"] = alarm.limits().upper_critical_value;
+    }
+
+    ROS_WARN_STREAM("Alarm for sensor " << info.sensor_name << ": " << alarm_state_name(alarm.state()) << " (" << value << ")");
+
+    {
+        std::unique_lock<std::mutex> lk(alarms_mutex);
+        if (alarm.state() == AlarmState::NONE) {
+            active_alarms.erase(info.sensor_id);
+        } else {
+            active_alarms[info.sensor_id] = event;
+        }
+    }
+
+    publish_json_bson("alarms/events", event);
+
+    publish_alarms();
+}
+
+std::shared_ptr<SensorLatency> create_sensor_latency(const std::string &sensor_id) {
+    auto latency = std::make_shared<SensorLatency>();
+    std::unique_lock<std::mutex> lk(sensor_latencies_mutex);
+    sensor_latencies[sensor_id] = latency;
+    return latency;
+}
+
+// Records how long the message took to arrive. Returns the stamp to publish, which is the receive time for unstamped messages.
+ros::Time record_sensor_stamp(SensorLatency &latency, const ros::Time &msg_stamp) {
+    const ros::Time now = ros::Time::now();
+    if (msg_stamp.isZero())
+        return now;
+    // Skip negative delays, the sensor's clock is ahead and the value would be meaningless
+    if (msg_stamp <= now) {
+        latency.sensor_to_bridge.record((now - msg_stamp).toNSec() / 1000);
+    }
+    return msg_stamp;
+}
+
+// Publishes a sensor value on sensors/<id>/data as text and on sensors/<id>/bson as {"d": value, "t": stamp in us}
+void publish_sensor_value(const std::string &sensor_id, const std::string &text, json value, const ros::Time &stamp) {
+    try_publish("sensors/" + sensor_id + "/data", text);
+
+    publish_bson("sensors/" + sensor_id + "/bson", sensor_value_to_json(std::move(value), stamp));
+}
+
+// received is when the bridge got the value, for the bridge_to_publish latency
+void publish_double_sensor(const Sensor &sensor, double value, const ros::Time &stamp,
+                           std::chrono::steady_clock::time_point received) {
+    sensor.history->push(stamp.toSec(), value);
+    if (sensor.alarm) {
+        update_sensor_alarm(sensor.info, *sensor.alarm, value, stamp);
+    }
+
+    if (history_log) {
+        LogRecord record{};
+        record.stamp_ns = stamp.toNSec();
+        record.type = LOG_RECORD_SENSOR_DOUBLE;
+        record.channel = sensor.log_channel;
+        record.values[0] = value;
+        history_log->append(record);
+    }
+
+    publish_sensor_value(sensor.info.sensor_id, std::to_string(value), value, stamp);
+    sensor.latency->bridge_to_publish.record(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - received).count());
+}
+
+void sensor_double_callback(const Sensor &sensor, double value, const ros::Time &stamp) {
+    XBOT_TRACE_SCOPE("sensor_double_callback");
+    const auto received = std::chrono::steady_clock::now();
+    publish_double_sensor(sensor, value, record_sensor_stamp(*sensor.latency, stamp), received);
+}
+
+void sensor_string_callback(const Sensor &sensor, const std::string &value, const ros::Time &msg_stamp) {
+    XBOT_TRACE_SCOPE("sensor_string_callback");
+    const auto received = std::chrono::steady_clock::now();
+    const ros::Time stamp = record_sensor_stamp(*sensor.latency, msg_stamp);
+    if (history_log) {
+        LogRecord record{};
+        record.stamp_ns = stamp.toNSec();
+        record.type = LOG_RECORD_SENSOR_STRING;
+        record.channel = sensor.log_channel;
+        HistoryLog::set_text(record, value);
+        history_log->append(record);
+    }
+
+    publish_sensor_value(sensor.info.sensor_id, value, value, stamp);
+    sensor.latency->bridge_to_publish.record(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - received).count());
+}
+
+bool has_sensor(const std::string &topic) {
+    auto lk = trace_lock(mqtt_callback_mutex, "wait mqtt_callback_mutex");
+    return found_sensors.count(topic) > 0;
+}
+
+// Registers the sensor without republishing the sensor infos
+const Sensor *create_sensor(const std::string &topic, const xbot_msgs::SensorInfo &info,
+                            bool has_value_description = true) {
+    if (info.value_type != xbot_msgs::SensorInfo::TYPE_DOUBLE && info.value_type != xbot_msgs::SensorInfo::TYPE_STRING) {
+        ROS_ERROR_STREAM("Inavlid Sensor Data Type: " << (int) info.value_type);
+        return nullptr;
+    }
+
+    auto sensor = std::make_unique<Sensor>();
+    sensor->info = info;
+    sensor->has_value_description = has_value_description;
+    if (info.value_type == xbot_msgs::SensorInfo::TYPE_DOUBLE) {
+        sensor->history = std::make_shared<SensorHistory>(config.history_size);
+        {
+            std::unique_lock<std::mutex> lk(sensor_histories_mutex);
+            sensor_histories[info.sensor_id] = sensor->history;
+        }
+        sensor->alarm = create_sensor_alarm(info);
+    }
+    sensor->log_channel = history_log ? history_log->channel(info.sensor_id) : 0;
+    sensor->latency = create_sensor_latency(info.sensor_id);
+
+    auto lk = trace_lock(mqtt_callback_mutex, "wait mqtt_callback_mutex");
+    auto &entry = found_sensors[topic];
+    entry = std::move(sensor);
+    return entry.get();
+}
+
+const Sensor *add_sensor(const std::string &topic, const xbot_msgs::SensorInfo &info) {
+    const Sensor *sensor = create_sensor(topic, info);
+    if (sensor)
+        publish_sensor_metadata();
+    return sensor;
+}
+
+// The bridge's own resource usage, published like any other sensor
+enum SelfSensor {
+    SELF_SENSOR_CPU,
+    SELF_SENSOR_RSS,
+    SELF_SENSOR_THREADS,
+    SELF_SENSOR_INBOUND_QUEUE,
+    SELF_SENSOR_OFFLINE_BUFFER,
+    SELF_SENSOR_MQTT_INFLIGHT,
+    SELF_SENSOR_COUNT
+};
+
+std::vector<const Sensor *> self_sensors;
+ProcessStats last_process_stats;
+ros::WallTime last_process_stats_time;
+
+// Without a value_description, the field keeps the message default and is published as "UNKNOWN"
+void add_self_sensor(const std::string &id, const std::string &name, const std::string &unit,
+                     bool has_value_description = false, uint8_t value_description = 0) {
+    xbot_msgs::SensorInfo info;
+    info.sensor_id = "xbot_monitoring_" + id;
+    info.sensor_name = name;
+    info.value_type = xbot_msgs::SensorInfo::TYPE_DOUBLE;
+    if (has_value_description)
+        info.value_description = value_description;
+    info.unit = unit;
+
+    // There is no such ROS topic, the key only has to be unique
+    self_sensors.push_back(create_sensor("/xbot_monitoring/sensors/" + info.sensor_id + "/info", info,
+                                         has_value_description));
+}
+
+void setup_self_monitoring() {
+    add_self_sensor("cpu", "Monitoring CPU", "%", true, xbot_msgs::SensorInfo::VALUE_DESCRIPTION_PERCENT);
+    add_self_sensor("rss", "Monitoring Memory", "MB");
+    add_self_sensor("threads", "Monitoring Threads", "");
+    add_self_sensor("inbound_queue", "Monitoring Inbound Queue", "");
+    add_self_sensor("offline_buffer", "Monitoring Offline Buffer", "");
+    add_self_sensor("mqtt_inflight", "Monitoring MQTT Inflight", "");
+    read_process_stats(last_process_stats);
+    last_process_stats_time = ros::WallTime::now();
+    publish_sensor_metadata();
+}
+
+void self_monitoring_callback() {
+    XBOT_TRACE_SCOPE("self_monitoring_callback");
+    ProcessStats stats;
+    if (!read_process_stats(stats))
+        return;
+    const ros::WallTime now = ros::WallTime::now();
+    const double elapsed = (now - last_process_stats_time).toSec();
+
+    double values[SELF_SENSOR_COUNT];
+    values[SELF_SENSOR_CPU] = elapsed > 0 ? (stats.cpu_time - last_process_stats.cpu_time) / elapsed * 100.0 : 0.0;
+    values[SELF_SENSOR_RSS] = static_cast<double>(stats.rss_bytes) / (1024.0 * 1024.0);
+    values[SELF_SENSOR_THREADS] = stats.threads;
+    values[SELF_SENSOR_INBOUND_QUEUE] = static_cast<double>(inbound_router.queue_size());
+    values[SELF_SENSOR_OFFLINE_BUFFER] = offline_buffer ? static_cast<double>(offline_buffer->size()) : 0.0;
+    values[SELF_SENSOR_MQTT_INFLIGHT] = static_cast<double>(egress->pending());
+    last_process_stats = stats;
+    last_process_stats_time = now;
+
+    const ros::Time stamp = ros::Time::now();
+    for (int i = 0; i < SELF_SENSOR_COUNT; i++) {
+        publish_double_sensor(*self_sensors[i], values[i], stamp, std::chrono::steady_clock::now());
+    }
+}
+
+void handle_history_request(const InboundMessagePtr &msg) {
+    XBOT_TRACE_SCOPE("handle_history_request");
+    json request;
+    try {
+        request = json::from_bson(msg->payload.begin(), msg->payload.end());
+    } catch (const json::exception &) {
+        // Not BSON, maybe the client sent plain JSON
+        try {
+            request = json::parse(msg->payload);
+        } catch (const json::exception &e) {
+            ROS_ERROR_STREAM("Error decoding /history/request: " << e.what());
+            return;
+        }
+    }
+
+    try {
+        const std::string client_id = request.at("client_id");
+        const std::string sensor_id = request.at("sensor_id");
+        const double since = request.value("since", 0.0);
+        const int max_points = request.value("max_points", 0);
+
+        if (client_id.empty() || client_id.find_first_of("/+#") != std::string::npos) {
+            ROS_ERROR_STREAM("Invalid client_id in history request: " << client_id);
+            return;
+        }
+
+        std::shared_ptr<SensorHistory> history;
+        {
+            std::unique_lock<std::mutex> lk(sensor_histories_mutex);
+            auto it = sensor_histories.find(sensor_id);
+            if (it != sensor_histories.end())
+                history = it->second;
+        }
+
+        json stamps = json::array();
+        json values = json::array();
+        if (history) {
+            for (const auto &sample: history->query(since, std::max(max_points, 0))) {
+                stamps.push_back(sample.stamp);
+                values.push_back(sample.value);
+            }
+        }
+
+        json data;
+        data["d"]["sensor_id"] = sensor_id;
+        data["d"]["stamps"] = stamps;
+        data["d"]["values"] = values;
+        publish_bson("history/response/" + client_id + "/bson", data);
+    } catch (const json::exception &e) {
+        ROS_ERROR_STREAM("Invalid history request: " << e.what());
+    }
+}
+
+// Returns the fields of current which are different in base, recursing into objects.
+json json_delta(const json &base, const json &current) {
+    json delta = json::object();
+    for (auto it = current.begin(); it != current.end(); ++it) {
+        auto base_it = base.find(it.key());
+        if (base_it == base.end()) {
+            delta[it.key()] = it.value();
+        } else if (it->is_object() && base_it->is_object()) {
+            json nested = json_delta(*base_it, *it);
+            if (!nested.empty())
+                delta[it.key()] = nested;
+        } else if (*it != *base_it) {
+            delta[it.key()] = it.value();
+        }
+    }
+    return delta;
+}
+
+void publish_robot_state(const json &j) {
+    if (!config.robot_state_delta) {
+        publish_json_bson("robot_state", j);
+        return;
+    }
+
+    const ros::Time now = ros::Time::now();
+    if (robot_state_keyframe.is_null() || (now - robot_state_keyframe_time).toSec() >= config.robot_state_keyframe_interval) {
+        robot_state_keyframe = j;
+        robot_state_keyframe_time = now;
+        robot_state_keyframe_seq++;
+
+        // Retain keyframes so that clients connecting later can apply the deltas right away.
+        // The JSON keyframe keeps its fields at the top level and gets the keyframe number as an additional field.
+        json keyframe = j;
+        keyframe["k"] = robot_state_keyframe_seq;
+        publish_json("robot_state/json", keyframe, true);
+        json data;
+        data["d"] = j;
+        data["k"] = robot_state_keyframe_seq;
+        publish_bson("robot_state/bson", data, true);
+        return;
+    }
+
+    // Deltas are relative to the keyframe, not the previous delta. So a single lost delta doesn't matter.
+    json data;
+    data["d"] = json_delta(robot_state_keyframe, j);
+    data["k"] = robot_state_keyframe_seq;
+    publish_json("robot_state/delta/json", data);
+    publish_bson("robot_state/delta/bson", data);
+}
+
+// Compact pose frame (18 bytes, little-endian):
+// u8 version, u8 flags (bit 0: heading valid), u16 seq, i32 x [mm], i32 y [mm], i16 heading [1e-4 rad],
+// u16 position accuracy [mm], u16 heading accuracy [1e-4 rad]
+void publish_robot_pose(const xbot_msgs::RobotState &msg) {
+    BinaryWriter w;
+    encode_robot_pose(msg, robot_pose_seq++, w);
+    try_publish_binary("robot_state/pose/bin", w.data().data(), w.size());
+}
+
+void publish_robot_status() {
+    json status;
+    {
+        std::unique_lock<std::mutex> lk(robot_status_mutex);
+        if (robot_status.is_null())
+            return;
+        status = robot_status;
+    }
+    publish_json_bson("robot_state/status", status, true);
+}
+
+void update_robot_status(const xbot_msgs::RobotState &msg) {
+    json status;
+    // Round the percentages, we don't want to publish on every bit of noise
+    status["battery_percentage"] = std::round(msg.battery_percentage * 1000.0) / 1000.0;
+    status["gps_percentage"] = std::round(msg.gps_percentage * 1000.0) / 1000.0;
+    status["current_action_progress"] = std::round(msg.current_action_progress * 1000.0) / 1000.0;
+    status["current_state"] = msg.current_state;
+    status["current_sub_state"] = msg.current_sub_state;
+    status["emergency"] = msg.emergency;
+    status["is_charging"] = msg.is_charging;
+
+    {
+        std::unique_lock<std::mutex> lk(robot_status_mutex);
+        if (status == robot_status)
+            return;
+        robot_status = status;
+    }
+    publish_robot_status();
+}
+
+// Full trail (little-endian): u8 version, u32 seq of the last point, u32 point count, count * (i32 x [mm], i32 y [mm])
+void publish_trail() {
+    BinaryWriter w;
+    {
+        std::unique_lock<std::mutex> lk(trail_mutex);
+        if (!trail)
+            return;
+        const auto &points = trail->points();
+        w.reserve(9 + points.size() * 8);
+        w.u8(1);
+        w.u32(trail->last_seq());
+        w.u32(points.size());
+        for (const auto &pt: points) {
+            w.i32(BinaryWriter::quantize<int32_t>(pt.x, 1000.0));
+            w.i32(BinaryWriter::quantize<int32_t>(pt.y, 1000.0));
+        }
+    }
+    try_publish_binary("robot_state/trail/bin", w.data().data(), w.size(), true);
+}
+
+// Appended point (little-endian): u8 version, u32 seq, i32 x [mm], i32 y [mm]
+void update_trail(const xbot_msgs::RobotState &msg) {
+    const ros::Time now = ros::Time::now();
+    BinaryWriter w;
+    bool added;
+    bool publish_full;
+    {
+        std::unique_lock<std::mutex> lk(trail_mutex);
+        const auto &pose = msg.robot_pose;
+        added = trail->add(now.toSec(), pose.pose.pose.position.x, pose.pose.pose.position.y, pose.vehicle_heading);
+        if (added) {
+            const auto &pt = trail->points().back();
+            w.u8(1);
+            w.u32(pt.seq);
+            w.i32(BinaryWriter::quantize<int32_t>(pt.x, 1000.0));
+            w.i32(BinaryWriter::quantize<int32_t>(pt.y, 1000.0));
+        }
+        // While parked no points are added, but old ones still expire and the retained trail has to catch up
+        const bool pruned = !added && trail->prune(now.toSec());
+        trail_changed = trail_changed || added || pruned;
+
+        publish_full = trail_changed && (now - trail_last_publish).toSec() >= config.trail_publish_interval;
+        if (publish_full) {
+            trail_last_publish = now;
+            trail_changed = false;
+        }
+    }
+    if (added)
+        try_publish_binary("robot_state/trail/append/bin", w.data().data(), w.size());
+    if (publish_full)
+        publish_trail();
+}
+
+void publish_robot_area() {
+    json area;
+    {
+        std::unique_lock<std::mutex> lk(robot_area_mutex);
+        if (robot_area.is_null())
+            return;
+        area = robot_area;
+    }
+    publish_json_bson("robot_state/area", area, true);
+}
+
+void update_robot_area(const xbot_msgs::RobotState &msg) {
+    auto index = std::atomic_load(&map_index);
+    if (!index)
+        return;
+
+    const Point2 p{msg.robot_pose.pose.pose.position.x, msg.robot_pose.pose.pose.position.y};
+
+    json area;
+    area["working_area"] = nullptr;
+    area["navigation_area"] = nullptr;
+    area["in_obstacle"] = false;
+    for (const auto *polygon: index->containing(p)) {
+        switch (polygon->type) {
+            case MapPolygonType::WORKING_AREA:
+                area["working_area"] = {{"index", polygon->area_index}, {"name", polygon->name}};
+                break;
+            case MapPolygonType::NAVIGATION_AREA:
+                area["navigation_area"] = {{"index", polygon->area_index}, {"name", polygon->name}};
+                break;
+            case MapPolygonType::OBSTACLE:
+                area["in_obstacle"] = true;
+                break;
+        }
+    }
+
+    double distance;
+    if (index->nearest_obstacle(p, config.obstacle_proximity_radius, distance) != nullptr) {
+        // Rounded, so that we only publish on meaningful changes
+        area["obstacle_distance"] = std::round(distance * 10.0) / 10.0;
+    } else {
+        area["obstacle_distance"] = nullptr;
+    }
+
+    {
+        std::unique_lock<std::mutex> lk(robot_area_mutex);
+        if (area == robot_area)
+            return;
+        robot_area = area;
+    }
+    publish_robot_area();
+}
+
+void robot_state_callback(const xbot_msgs::RobotState &msg) {
+    XBOT_TRACE_SCOPE("robot_state_callback");
+    const json j = robot_state_to_json(msg);
+
+    if (history_log) {
+        const uint64_t stamp_ns = ros::Time::now().toNSec();
+
+        LogRecord pose{};
+        pose.stamp_ns = stamp_ns;
+        pose.type = LOG_RECORD_ROBOT_POSE;
+        pose.flags = msg.robot_pose.orientation_valid ? 1 : 0;
+        pose.values[0] = msg.robot_pose.pose.pose.position.x;
+        pose.values[1] = msg.robot_pose.pose.pose.position.y;
+        pose.values[2] = msg.robot_pose.vehicle_heading;
+        history_log->append(pose);
+
+        LogRecord status{};
+        status.stamp_ns = stamp_ns;
+        status.type = LOG_RECORD_ROBOT_STATUS;
+        status.flags = (msg.is_charging ? 1 : 0) | (msg.emergency ? 2 : 0);
+        status.values[0] = msg.battery_percentage;
+        status.values[1] = msg.gps_percentage;
+        status.values[2] = msg.current_action_progress;
+        HistoryLog::set_text(status, msg.current_state);
+        history_log->append(status);
+    }
+
+    publish_robot_state(j);
+
+    if (config.robot_state_split) {
+        publish_robot_pose(msg);
+        update_robot_status(msg);
+    }
+
+    if (trail) {
+        update_trail(msg);
+    }
+
+    update_robot_area(msg);
+}
+
+json action_to_json(const std::string &prefix, const xbot_msgs::ActionInfo &action) {
+    json action_info;
+    action_info["action_id"] = prefix + "/" + action.action_id;
+    action_info["action_name"] = action.action_name;
+    action_info["enabled"] = action.enabled;
+    return action_info;
+}
+
+// Node topics live in their own sub-namespace, so that no prefix can collide with actions/events or actions/{json,bson}
+void publish_node_actions(const std::string &prefix, const json &actions) {
+    publish_json_bson("actions/node/" + prefix, actions, true);
+}
+
+// The prefix becomes part of the node's topic, so it must not contain wildcards or empty levels
+bool valid_action_prefix(const std::string &prefix) {
+    return !prefix.empty() && prefix.find_first_of("+#") == std::string::npos && prefix.front() != '/' &&
+           prefix.back() != '/' && prefix.find("//") == std::string::npos;
+}
+
+void publish_full_actions() {
+    json actions = json::array();
+    std::unique_lock<std::mutex> lk(actions_mutex);
+    for(const auto &kv : registered_actions) {
+        for(const auto &action : kv.second) {
+            actions.push_back(action_to_json(kv.first, action));
+        }
+    }
+    lk.unlock();
+
+    publish_json_bson("actions", actions, true);
+}
+
+void publish_actions() {
+    std::map<std::string, json> node_actions;
+    {
+        std::unique_lock<std::mutex> lk(actions_mutex);
+        for (const auto &kv: registered_actions) {
+            json &actions = node_actions[kv.first] = json::array();
+            for (const auto &action: kv.second) {
+                actions.push_back(action_to_json(kv.first, action));
+            }
+        }
+    }
+    for (const auto &kv: node_actions) {
+        publish_node_actions(kv.first, kv.second);
+    }
+
+    if (config.publish_full_action_list) {
+        publish_full_actions();
+    } else {
+        // Don't leave an outdated list retained on the broker
+        try_publish("actions/json", "", true);
+        try_publish("actions/bson", "", true);
+    }
+}
+
+std::string tile_name(const TileKey &key) {
+    return std::to_string(key.x) + "_" + std::to_string(key.y);
+}
+
+// Publishes the tiles and their index as <prefix>/<x>_<y> and <prefix>/index.
+// If changed_only is set, tiles which are retained with the same content already are skipped, as is the index if no
+// tile changed.
+void publish_tiles(const std::string &prefix, const std::map<TileKey, json> &tiles,
+                   std::map<TileKey, size_t> &published, bool changed_only) {
+    json index;
+    index["tile_size"] = config.map_tile_size;
+    index["tiles"] = json::array();
+
+    std::map<TileKey, size_t> current;
+    bool changed = !changed_only || tiles.size() != published.size();
+    for (const auto &kv: tiles) {
+        const size_t hash = std::hash<std::string>()(kv.second.dump());
+        const auto it = published.find(kv.first);
+        if (!changed_only || it == published.end() || it->second != hash) {
+            publish_json_bson(prefix + "/" + tile_name(kv.first), kv.second, true);
+            changed = true;
+        }
+
+        index["tiles"].push_back({{"x", kv.first.x}, {"y", kv.first.y}, {"point_count", kv.second["point_count"]}});
+        current.emplace(kv.first, hash);
+    }
+
+    // Empty retained messages remove the tiles which aren't part of the map anymore
+    for (const auto &kv: published) {
+        if (current.count(kv.first) == 0) {
+            try_publish(prefix + "/" + tile_name(kv.first) + "/json", "", true);
+            try_publish(prefix + "/" + tile_name(kv.first) + "/bson", "", true);
+            changed = true;
+        }
+    }
+    published = std::move(current);
+
+    if (changed)
+        publish_json_bson(prefix + "/index", index, true);
+}
+
+// changed_tiles_only skips the tiles which didn't change since they were last published, so it must not be set when
+// the retained messages have to be restored, e.g. after connecting
+void publish_map(bool changed_tiles_only) {
+    std::unique_lock<std::mutex> lk(map_mutex);
+    if(!has_map)
+        return;
+    // The summary first, so that clients can decide whether they need the full map
+    publish_json_bson("map/summary", map_summary, true);
+
+    publish_json_bson("map", map, true);
+
+    if (config.map_tile_size > 0)
+        publish_tiles("map/tiles", map_tiles, published_map_tiles, changed_tiles_only);
+}
+
+void publish_map_overlay(bool changed_tiles_only) {
+    std::unique_lock<std::mutex> lk(map_mutex);
+    if(!has_map_overlay)
+        return;
+    publish_json_bson("map_overlay", map_overlay, true);
+
+    if (config.map_tile_size > 0)
+        publish_tiles("map_overlay/tiles", map_overlay_tiles, published_map_overlay_tiles, changed_tiles_only);
+}
+
+json bounds_to_json(const BoundingBox &bounds) {
+    if (bounds.empty())
+        return nullptr;
+    json j;
+    j["min_x"] = bounds.min_x;
+    j["min_y"] = bounds.min_y;
+    j["max_x"] = bounds.max_x;
+    j["max_y"] = bounds.max_y;
+    return j;
+}
+
+json polygon_summary(const MapPolygon &polygon) {
+    json j;
+    j["bounds"] = bounds_to_json(polygon_bounds(polygon.points));
+    j["area"] = polygon.points.size() >= 3 ? polygon_area(polygon.points) : 0.0;
+    j["perimeter"] = polygon.points.size() >= 2 ? polygon_perimeter(polygon.points) : 0.0;
+    j["point_count"] = polygon.points.size();
+    return j;
+}
+
+// Expects obstacles to directly follow their area, as built in map_callback
+json build_map_summary(const std::vector<MapPolygon> &polygons) {
+    json working_areas = json::array();
+    json navigation_areas = json::array();
+    BoundingBox bounds;
+    size_t point_count = 0;
+    json *current_area = nullptr;
+
+    for (const auto &polygon: polygons) {
+        point_count += polygon.points.size();
+        bounds.extend(polygon_bounds(polygon.points));
+
+        json summary = polygon_summary(polygon);
+        switch (polygon.type) {
+            case MapPolygonType::WORKING_AREA:
+            case MapPolygonType::NAVIGATION_AREA: {
+                auto &areas = polygon.type == MapPolygonType::WORKING_AREA ? working_areas : navigation_areas;
+                summary["name"] = polygon.name;
+                summary["obstacles"] = json::array();
+                areas.push_back(summary);
+                current_area = &areas.back();
+                break;
+            }
+            case MapPolygonType::OBSTACLE:
+                if (current_area != nullptr)
+                    (*current_area)["obstacles"].push_back(summary);
+                break;
+        }
+    }
+
+    json j;
+    j["bounds"] = bounds_to_json(bounds);
+    j["point_count"] = point_count;
+    j["working_areas"] = working_areas;
+    j["navigation_areas"] = navigation_areas;
+    return j;
+}
+
+json points_to_json(const std::vector<Point2> &points) {
+    json j = json::array();
+    for (const auto &pt: points) {
+        json p_j;
+        p_j["x"] = pt.x;
+        p_j["y"] = pt.y;
+        j.push_back(p_j);
+    }
+    return j;
+}
+
+json &tile_for(std::map<TileKey, json> &tiles, const TileGrid &grid, const TileKey &key) {
+    auto it = tiles.find(key);
+    if (it == tiles.end()) {
+        json tile;
+        tile["x"] = key.x;
+        tile["y"] = key.y;
+        tile["bounds"] = bounds_to_json(grid.tile_bounds(key));
+        tile["point_count"] = 0;
+        it = tiles.emplace(key, tile).first;
+    }
+    return it->second;
+}
+
+// Finite points of the polygon or empty if it covers too many tiles, logs why
+std::vector<Point2> tileable_points(const TileGrid &grid, const std::vector<Point2> &points, const std::string &name) {
+    std::vector<Point2> finite = finite_points(points);
+    if (finite.size() != points.size()) {
+        ROS_ERROR_STREAM_THROTTLE(1.0, "Skipping " << points.size() - finite.size() << " non-finite points of " << name);
+    }
+    const size_t tile_count = grid.tile_count(polygon_bounds(finite));
+    if (tile_count > MAX_TILES_PER_POLYGON) {
+        ROS_ERROR_STREAM_THROTTLE(1.0, "Not tiling " << name << ", it would cover " << tile_count << " tiles (max "
+                                                      << MAX_TILES_PER_POLYGON << "). Check its points and map_tile_size.");
+        finite.clear();
+    }
+    return finite;
+}
+
+bool map_tiles_full(const std::map<TileKey, json> &tiles) {
+    if (tiles.size() < MAX_TILES_PER_MAP)
+        return false;
+    ROS_ERROR_STREAM_THROTTLE(1.0, "Map covers more than " << MAX_TILES_PER_MAP << " tiles, the rest is left out. Check map_tile_size.");
+    return true;
+}
+
+// Clips the map's polygons into tiles. Each tile looks like a small map, areas keep their index in the full map.
+// Expects obstacles to directly follow their area, as built in map_callback
+std::map<TileKey, json> build_map_tiles(const std::vector<MapPolygon> &polygons) {
+    const TileGrid grid(config.map_tile_size);
+    std::map<TileKey, json> tiles;
+    MapPolygonType area_type = MapPolygonType::WORKING_AREA;
+    for (const auto &polygon: polygons) {
+        if (polygon.type != MapPolygonType::OBSTACLE)
+            area_type = polygon.type;
+        const std::vector<Point2> points = tileable_points(grid, polygon.points, "map polygon " + polygon.name);
+        if (points.size() < 3)
+            continue;
+
+        for (const auto &key: grid.tiles(polygon_bounds(points))) {
+            auto clipped = clip_polygon(points, grid.tile_bounds(key));
+            if (clipped.empty())
+                continue;
+            if (tiles.count(key) == 0 && map_tiles_full(tiles))
+                return tiles;
+
+            json &tile = tile_for(tiles, grid, key);
+            tile["point_count"] = tile["point_count"].get<size_t>() + clipped.size();
+
+            json &areas = tile[area_type == MapPolygonType::NAVIGATION_AREA ? "navigation_areas" : "working_areas"];
+            if (areas.is_null())
+                areas = json::array();
+            auto area_it = std::find_if(areas.begin(), areas.end(), [&polygon](const json &area) {
+                return area["index"] == polygon.area_index;
+            });
+            if (area_it == areas.end()) {
+                json area_j;
+                area_j["index"] = polygon.area_index;
+                area_j["name"] = polygon.name;
+                area_j["outline"] = json::array();
+                area_j["obstacles"] = json::array();
+                areas.push_back(area_j);
+                area_it = areas.end() - 1;
+            }
+
+            if (polygon.type == MapPolygonType::OBSTACLE) {
+                (*area_it)["obstacles"].push_back(points_to_json(clipped));
+            } else {
+                (*area_it)["outline"] = points_to_json(clipped);
+            }
+        }
+    }
+    return tiles;
+}
+
+std::map<TileKey, json> build_map_overlay_tiles(const xbot_msgs::MapOverlay &overlay) {
+    const TileGrid grid(config.map_tile_size);
+    std::map<TileKey, json> tiles;
+    for (const auto &poly: overlay.polygons) {
+        if (poly.polygon.points.size() < 2)
+            continue;
+        std::vector<Point2> points;
+        for (const auto &pt: poly.polygon.points) {
+            points.push_back({pt.x, pt.y});
+        }
+        points = tileable_points(grid, points, "overlay polygon");
+        if (points.size() < 2)
+            continue;
+
+        for (const auto &key: grid.tiles(polygon_bounds(points))) {
+            const BoundingBox tile_bounds = grid.tile_bounds(key);
+            std::vector<std::vector<Point2>> pieces;
+            if (poly.closed && points.size() >= 3) {
+                auto clipped = clip_polygon(points, tile_bounds);
+                if (!clipped.empty())
+                    pieces.push_back(std::move(clipped));
+            } else {
+                pieces = clip_polyline(points, tile_bounds);
+            }
+
+            if (!pieces.empty() && tiles.count(key) == 0 && map_tiles_full(tiles))
+                return tiles;
+            for (const auto &piece: pieces) {
+                json &tile = tile_for(tiles, grid, key);
+                tile["point_count"] = tile["point_count"].get<size_t>() + piece.size();
+                json poly_j;
+                poly_j["poly"] = points_to_json(piece);
+                poly_j["is_closed"] = poly.closed && points.size() >= 3;
+                poly_j["line_width"] = poly.line_width;
+                poly_j["color"] = poly.color;
+                tile["polygons"].push_back(poly_j);
+            }
+        }
+    }
+    return tiles;
+}
+
+void map_callback(const xbot_msgs::Map &msg) {
+    XBOT_TRACE_SCOPE("map_callback");
+    json j = map_to_json(msg);
+
+    // Collect the polygons for the summary and the spatial index for the robot_state/area lookups
+    std::vector<MapPolygon> polygons = map_polygons(msg);
+    json summary = build_map_summary(polygons);
+    std::map<TileKey, json> tiles;
+    if (config.map_tile_size > 0)
+        tiles = build_map_tiles(polygons);
+    std::atomic_store(&map_index, std::shared_ptr<const MapIndex>(std::make_shared<MapIndex>(std::move(polygons))));
+
+    {
+        std::unique_lock<std::mutex> lk(map_mutex);
+        map = std::move(j);
+        map_summary = std::move(summary);
+        map_tiles = std::move(tiles);
+        has_map = true;
+    }
+
+    publish_map(true);
+}
+
+
+void map_overlay_callback(const xbot_msgs::MapOverlay &msg) {
+    XBOT_TRACE_SCOPE("map_overlay_callback");
+    json j = map_overlay_to_json(msg);
+    std::map<TileKey, json> tiles;
+    if (config.map_tile_size > 0)
+        tiles = build_map_overlay_tiles(msg);
+
+    {
+        std::unique_lock<std::mutex> lk(map_mutex);
+        map_overlay = std::move(j);
+        map_overlay_tiles = std::move(tiles);
+        has_map_overlay = true;
+    }
+
+    publish_map_overlay(true);
+}
+
+
+void teleop_watchdog_callback() {
+    {
+        std::unique_lock<std::mutex> lk(teleop_mutex);
+        if (!teleop_active ||
+            std::chrono::steady_clock::now() - teleop_last_command <= std::chrono::duration<double>(config.teleop_timeout))
+            return;
+        teleop_active = false;
+    }
+    ROS_WARN_STREAM("No teleop command for " << config.teleop_timeout << "s, stopping the robot");
+    ingress->send_cmd_vel(0.0, 0.0);
+}
+
+void register_actions(const std::string &node_prefix, const std::vector<xbot_msgs::ActionInfo> &actions) {
+    XBOT_TRACE_SCOPE("register_actions");
+
+    ROS_INFO_STREAM("new actions registered: " << node_prefix << " registered " << actions.size() << " actions.");
+    if (!valid_action_prefix(node_prefix)) {
+        ROS_ERROR_STREAM("Ignoring actions of invalid node prefix \"" << node_prefix << "\"");
+        return;
+    }
+
+    json added = json::array();
+    json changed = json::array();
+    json removed = json::array();
+    json node_actions = json::array();
+    {
+        std::unique_lock<std::mutex> lk(actions_mutex);
+        auto existing = registered_actions.find(node_prefix);
+        const bool is_new_node = existing == registered_actions.end();
+
+        std::map<std::string, const xbot_msgs::ActionInfo *> old_actions;
+        if (!is_new_node) {
+            for (const auto &action: existing->second) {
+                old_actions[action.action_id] = &action;
+            }
+        }
+        for (const auto &action: actions) {
+            auto old = old_actions.find(action.action_id);
+            if (old == old_actions.end()) {
+                added.push_back(action_to_json(node_prefix, action));
+            } else {
+                if (old->second->enabled != action.enabled || old->second->action_name != action.action_name)
+                    changed.push_back(action_to_json(node_prefix, action));
+                old_actions.erase(old);
+            }
+        }
+        for (const auto &kv: old_actions) {
+            removed.push_back(node_prefix + "/" + kv.first);
+        }
+
+        // Nodes re-register on every state change, mostly with the same actions
+        if (!is_new_node && added.empty() && changed.empty() && removed.empty())
+            return;
+
+        for (const auto &id: removed) {
+            action_index.erase(id.get<std::string>());
+        }
+        for (const auto &action: actions) {
+            action_index[node_prefix + "/" + action.action_id] = action.enabled;
+            node_actions.push_back(action_to_json(node_prefix, action));
+        }
+        registered_actions[node_prefix] = actions;
+    }
+
+    publish_node_actions(node_prefix, node_actions);
+
+    json event;
+    event["prefix"] = node_prefix;
+    event["added"] = added;
+    event["changed"] = changed;
+    event["removed"] = removed;
+    publish_json_bson("actions/events", event);
+
+    if (config.publish_full_action_list)
+        publish_full_actions();
+}
+
+
+void handle_connected() {
+    ROS_INFO_STREAM("MQTT Connected");
+    {
+        std::unique_lock<std::mutex> lk(offline_replay_mutex);
+        mqtt_connected = true;
+    }
+    offline_replay_cv.notify_all();
+    publish_sensor_metadata();
+    publish_map();
+    publish_map_overlay();
+    publish_actions();
+    publish_alarms();
+    publish_robot_status();
+    publish_trail();
+    publish_robot_area();
+
+
+    for (const auto &filter: inbound_router.filters()) {
+        egress->subscribe(filter);
+    }
+}
+
+void handle_connection_lost() {
+    std::unique_lock<std::mutex> lk(offline_replay_mutex);
+    mqtt_connected = false;
+}
+
+void handle_inbound_message(const InboundMessagePtr &msg) {
+    XBOT_TRACE_SCOPE("message_arrived");
+    const int family = metrics().topic_family(msg->topic);
+    metrics().add(family, MetricCounter::MESSAGES_IN);
+    metrics().add(family, MetricCounter::BYTES_IN, msg->payload.size());
+    if (!inbound_router.dispatch(msg->topic, msg)) {
+        metrics().add(family, MetricCounter::DROPS);
+        ROS_WARN_STREAM_THROTTLE(1.0, "Dropped message on " << msg->topic << " (no handler or queue full)");
+    }
+}
+
+void bridge_init(const BridgeConfig &bridge_config, Egress &bridge_egress, Ingress &bridge_ingress) {
+    config = bridge_config;
+    egress = &bridge_egress;
+    ingress = &bridge_ingress;
+    if (config.history_size <= 0 || static_cast<size_t>(config.history_size) > SENSOR_HISTORY_MAX_CAPACITY) {
+        const int history_size = std::max(1, std::min(config.history_size, static_cast<int>(SENSOR_HISTORY_MAX_CAPACITY)));
+        ROS_WARN_STREAM("history_size " << config.history_size << " is out of range, using " << history_size);
+        config.history_size = history_size;
+    }
+    has_map = false;
+    has_map_overlay = false;
+
+    if (!config.offline_buffer_topics.empty()) {
+        if (config.offline_buffer_replay_rate <= 0)
+            config.offline_buffer_replay_rate = 50.0;
+        offline_buffer = std::make_unique<OfflineBuffer>(
+                config.offline_buffer_mode == "latest" ? OfflineBuffer::Mode::LATEST : OfflineBuffer::Mode::ORDERED,
+                static_cast<size_t>(config.offline_buffer_max_size_kb) << 10, config.offline_buffer_spill_path,
+                static_cast<size_t>(config.offline_buffer_max_spill_size_mb) << 20);
+    }
+
+    if (config.trail_enabled) {
+        trail = std::make_unique<TrajectoryTrail>(config.trail_min_distance, config.trail_min_angle,
+                                                  config.trail_max_age, config.trail_max_points);
+    }
+
+    if (!config.history_log_dir.empty()) {
+        history_log = std::make_unique<HistoryLog>(config.history_log_dir,
+                                                   static_cast<size_t>(config.history_log_segment_size_mb) << 20,
+                                                   config.history_log_max_segments);
+        if (history_log->start()) {
+            ROS_INFO_STREAM("Logging history to " << config.history_log_dir);
+        } else {
+            ROS_ERROR_STREAM("Could not start history log in " << config.history_log_dir);
+            history_log.reset();
+        }
+    }
+
+    using Context = InboundRouter<InboundMessagePtr>::Context;
+    inbound_router.set_queue_delay_callback([](const std::string &topic, uint64_t delay_ns) {
+        metrics().record(metrics().topic_family(topic), MetricTiming::QUEUE_DELAY, delay_ns);
+    });
+    inbound_router.add("/teleop", Context::INLINE, handle_teleop);
+    inbound_router.add("/action", Context::WORKER, handle_action);
+    inbound_router.add("/command", Context::WORKER, handle_command);
+    inbound_router.add("/history/request", Context::WORKER, handle_history_request);
+}
+
+void bridge_start() {
+    bridge_running = true;
+    inbound_router.start();
+    if (offline_buffer) {
+        offline_replay_thread = std::thread(replay_offline_buffer);
+    }
+}
+
+void bridge_stop() {
+    {
+        std::unique_lock<std::mutex> lk(offline_replay_mutex);
+        bridge_running = false;
+    }
+    offline_replay_cv.notify_all();
+    if (offline_replay_thread.joinable()) {
+        offline_replay_thread.join();
+    }
+    inbound_router.stop();
+}
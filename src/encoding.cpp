@@ -0,0 +1,234 @@
+#include "xbot_monitoring/encoding.h"
+
+#include <cmath>
+
+using json = nlohmann::json;
+
+json sensor_info_to_json(const xbot_msgs::SensorInfo &info) {
+    json j;
+    j["sensor_id"] = info.sensor_id;
+    j["sensor_name"] = info.sensor_name;
+
+    switch (info.value_type) {
+        case xbot_msgs::SensorInfo::TYPE_STRING: {
+            j["value_type"] = "STRING";
+            break;
+        }
+        case xbot_msgs::SensorInfo::TYPE_DOUBLE: {
+            j["value_type"] = "DOUBLE";
+            break;
+        }
+        default: {
+            j["value_type"] = "UNKNOWN";
+            break;
+        }
+
+
+    }
+
+    switch (info.value_description) {
+        case xbot_msgs::SensorInfo::VALUE_DESCRIPTION_TEMPERATURE: {
+            j["value_description"] = "TEMPERATURE";
+            break;
+        }
+        case xbot_msgs::SensorInfo::VALUE_DESCRIPTION_VELOCITY: {
+            j["value_description"] = "VELOCITY";
+            break;
+        }
+        case xbot_msgs::SensorInfo::VALUE_DESCRIPTION_ACCELERATION: {
+            j["value_description"] = "ACCELERATION";
+            break;
+        }
+        case xbot_msgs::SensorInfo::VALUE_DESCRIPTION_VOLTAGE: {
+            j["value_description"] = "VOLTAGE";
+            break;
+        }
+        case xbot_msgs::SensorInfo::VALUE_DESCRIPTION_CURRENT: {
+            j["value_description"] = "CURRENT";
+            break;
+        }
+        case xbot_msgs::SensorInfo::VALUE_DESCRIPTION_PERCENT: {
+            j["value_description"] = "PERCENT";
+            break;
+        }
+        default: {
+            j["value_description"] = "UNKNOWN";
+            break;
+        }
+    }
+
+    j["unit"] = info.unit;
+    j["has_min_max"] = info.has_min_max;
+    j["min_value"] = info.min_value;
+    j["max_value"] = info.max_value;
+    j["has_critical_low"] = info.has_critical_low;
+    j["lower_critical_value"] = info.lower_critical_value;
+    j["has_critical_high"] = info.has_critical_high;
+    j["upper_critical_value"] = info.upper_critical_value;
+    return j;
+}
+
+json sensor_value_to_json(json value, const ros::Time &stamp) {
+    json data;
+    data["d"] = std::move(value);
+    data["t"] = static_cast<int64_t>(stamp.toNSec() / 1000);
+    return data;
+}
+
+json robot_state_to_json(const xbot_msgs::RobotState &msg) {
+    json j;
+
+    j["battery_percentage"] = msg.battery_percentage;
+    j["gps_percentage"] = msg.gps_percentage;
+    j["current_action_progress"] = msg.current_action_progress;
+    j["current_state"] = msg.current_state;
+    j["current_sub_state"] = msg.current_sub_state;
+    j["emergency"] = msg.emergency;
+    j["is_charging"] = msg.is_charging;
+    j["pose"]["x"] = msg.robot_pose.pose.pose.position.x;
+    j["pose"]["y"] = msg.robot_pose.pose.pose.position.y;
+    j["pose"]["heading"] = msg.robot_pose.vehicle_heading;
+    j["pose"]["pos_accuracy"] = msg.robot_pose.position_accuracy;
+    j["pose"]["heading_accuracy"] = msg.robot_pose.orientation_accuracy;
+    j["pose"]["heading_valid"] = msg.robot_pose.orientation_valid;
+    return j;
+}
+
+void encode_robot_pose(const xbot_msgs::RobotState &msg, uint16_t seq, BinaryWriter &w) {
+    const auto &pose = msg.robot_pose;
+    w.reserve(18);
+    w.u8(1);
+    w.u8(pose.orientation_valid ? 1 : 0);
+    w.u16(seq);
+    w.i32(BinaryWriter::quantize<int32_t>(pose.pose.pose.position.x, 1000.0));
+    w.i32(BinaryWriter::quantize<int32_t>(pose.pose.pose.position.y, 1000.0));
+    w.i16(BinaryWriter::quantize<int16_t>(std::remainder(pose.vehicle_heading, 2.0 * M_PI), 10000.0));
+    w.u16(BinaryWriter::quantize<uint16_t>(pose.position_accuracy, 1000.0));
+    w.u16(BinaryWriter::quantize<uint16_t>(pose.orientation_accuracy, 10000.0));
+}
+
+json map_to_json(const xbot_msgs::Map &msg) {
+    json j;
+
+    j["docking_pose"]["x"] = msg.dockX;
+    j["docking_pose"]["y"] = msg.dockY;
+    j["docking_pose"]["heading"] = msg.dockHeading;
+
+    j["meta"]["mapWidth"] = msg.mapWidth;
+    j["meta"]["mapHeight"] = msg.mapHeight;
+    j["meta"]["mapCenterX"] = msg.mapCenterX;
+    j["meta"]["mapCenterY"] = msg.mapCenterY;
+
+
+    json working_areas_j;
+    for(const auto &area : msg.workingArea) {
+        json area_j;
+        area_j["name"] = area.name;
+        {
+            json outline_poly_j;
+            for (const auto &pt: area.area.points) {
+                json p_j;
+                p_j["x"] = pt.x;
+                p_j["y"] = pt.y;
+                outline_poly_j.push_back(p_j);
+            }
+            area_j["outline"] = outline_poly_j;
+        }
+        json obstacle_polys_j;
+        for(const auto &obstacle : area.obstacles) {
+            json obstacle_poly_j;
+            for(const auto &pt : obstacle.points) {
+                json p_j;
+                p_j["x"] = pt.x;
+                p_j["y"] = pt.y;
+                obstacle_poly_j.push_back(p_j);
+            }
+            obstacle_polys_j.push_back(obstacle_poly_j);
+        }
+        area_j["obstacles"] = obstacle_polys_j;
+        working_areas_j.push_back(area_j);
+    }
+    json navigation_areas_j;
+
+    for(const auto &area : msg.navigationAreas) {
+        json area_j;
+        area_j["name"] = area.name;
+        {
+            json outline_poly_j;
+            for (const auto &pt: area.area.points) {
+                json p_j;
+                p_j["x"] = pt.x;
+                p_j["y"] = pt.y;
+                outline_poly_j.push_back(p_j);
+            }
+            area_j["outline"] = outline_poly_j;
+        }
+        json obstacle_polys_j;
+        for(const auto &obstacle : area.obstacles) {
+            json obstacle_poly_j;
+            for(const auto &pt : obstacle.points) {
+                json p_j;
+                p_j["x"] = pt.x;
+                p_j["y"] = pt.y;
+                obstacle_poly_j.push_back(p_j);
+            }
+            obstacle_polys_j.push_back(obstacle_poly_j);
+        }
+        area_j["obstacles"] = obstacle_polys_j;
+        navigation_areas_j.push_back(area_j);
+    }
+
+    j["working_areas"] = working_areas_j;
+    j["navigation_areas"] = navigation_areas_j;
+    return j;
+}
+
+std::vector<MapPolygon> map_polygons(const xbot_msgs::Map &msg) {
+    std::vector<MapPolygon> polygons;
+    const auto add_areas = [&polygons](const std::vector<xbot_msgs::MapArea> &areas, MapPolygonType type) {
+        for (size_t i = 0; i < areas.size(); i++) {
+            MapPolygon polygon{type, areas[i].name, static_cast<int>(i)};
+            for (const auto &pt: areas[i].area.points) {
+                polygon.points.push_back({pt.x, pt.y});
+            }
+            polygons.push_back(std::move(polygon));
+            for (const auto &obstacle: areas[i].obstacles) {
+                MapPolygon obstacle_polygon{MapPolygonType::OBSTACLE, areas[i].name, static_cast<int>(i)};
+                for (const auto &pt: obstacle.points) {
+                    obstacle_polygon.points.push_back({pt.x, pt.y});
+                }
+                polygons.push_back(std::move(obstacle_polygon));
+            }
+        }
+    };
+    add_areas(msg.workingArea, MapPolygonType::WORKING_AREA);
+    add_areas(msg.navigationAreas, MapPolygonType::NAVIGATION_AREA);
+    return polygons;
+}
+
+json map_overlay_to_json(const xbot_msgs::MapOverlay &msg) {
+    json polys;
+    for(const auto &poly : msg.polygons) {
+        if(poly.polygon.points.size() < 2)
+            continue;
+        json poly_j;
+        {
+            json outline_poly_j;
+            for (const auto &pt: poly.polygon.points) {
+                json p_j;
+                p_j["x"] = pt.x;
+                p_j["y"] = pt.y;
+                outline_poly_j.push_back(p_j);
+            }
+            poly_j["poly"] = outline_poly_j;
+            poly_j["is_closed"] = poly.closed;
+            poly_j["line_width"] = poly.line_width;
+            poly_j["color"] = poly.color;
+        }
+        polys.push_back(poly_j);
+    }
+
+    json j;
+    j["polygons"] = polys;
+    return j;
+}
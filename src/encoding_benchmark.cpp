@@ -0,0 +1,216 @@
+//
+// Benchmarks for the encoding paths. Besides ns/op, every benchmark reports the encoded size ("bytes")
+// and the heap allocations per iteration ("allocs").
+//
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include <benchmark/benchmark.h>
+#include "xbot_monitoring/encoding.h"
+#include "xbot_monitoring/synthetic_messages.h"
+
+using json = nlohmann::json;
+
+namespace {
+std::atomic<uint64_t> allocations{0};
+
+// Counts allocations between construction and finish()
+class AllocationCounter {
+public:
+    explicit AllocationCounter(benchmark::State &state) : state_(state), start_(allocations.load()) {
+    }
+
+    void finish() {
+        state_.counters["allocs"] = benchmark::Counter(static_cast<double>(allocations.load() - start_),
+                                                      benchmark::Counter::kAvgIterations);
+    }
+
+    // bytes is the encoded size of one iteration
+    void finish(size_t bytes) {
+        finish();
+        state_.counters["bytes"] = static_cast<double>(bytes);
+        state_.SetBytesProcessed(static_cast<int64_t>(state_.iterations() * bytes));
+    }
+
+private:
+    benchmark::State &state_;
+    uint64_t start_;
+};
+
+xbot_msgs::SensorInfo make_sensor_info(int i) {
+    xbot_msgs::SensorInfo info;
+    info.sensor_id = "sensor_" + std::to_string(i);
+    info.sensor_name = "Sensor " + std::to_string(i);
+    info.value_type = xbot_msgs::SensorInfo::TYPE_DOUBLE;
+    info.value_description = xbot_msgs::SensorInfo::VALUE_DESCRIPTION_VOLTAGE;
+    info.unit = "V";
+    info.has_min_max = true;
+    info.min_value = 0.0;
+    info.max_value = 30.0;
+    info.has_critical_low = true;
+    info.lower_critical_value = 21.0;
+    return info;
+}
+
+// The map with about points points in total, spread over 4 working areas with an obstacle each and the navigation area
+xbot_msgs::Map map_with_points(int points) {
+    return make_map(4, 1, std::max(3, points / 9));
+}
+
+xbot_msgs::MapOverlay map_overlay_with_points(int points) {
+    return make_map_overlay(10, std::max(2, points / 10), 0);
+}
+}
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+static void BM_SensorDouble(benchmark::State &state) {
+    const ros::Time stamp(1700000000, 123456789);
+    size_t bytes = 0;
+    AllocationCounter counter(state);
+    for (auto _: state) {
+        auto bson = json::to_bson(sensor_value_to_json(23.456, stamp));
+        bytes = bson.size();
+        benchmark::DoNotOptimize(bson.data());
+    }
+    counter.finish(bytes);
+}
+BENCHMARK(BM_SensorDouble);
+
+static void BM_SensorString(benchmark::State &state) {
+    const ros::Time stamp(1700000000, 123456789);
+    const std::string value = "Waiting for GPS fix";
+    size_t bytes = 0;
+    AllocationCounter counter(state);
+    for (auto _: state) {
+        auto bson = json::to_bson(sensor_value_to_json(value, stamp));
+        bytes = bson.size();
+        benchmark::DoNotOptimize(bson.data());
+    }
+    counter.finish(bytes);
+}
+BENCHMARK(BM_SensorString);
+
+static void BM_RobotStateJson(benchmark::State &state) {
+    const auto msg = make_robot_state(100.0);
+    size_t bytes = 0;
+    AllocationCounter counter(state);
+    for (auto _: state) {
+        auto data = robot_state_to_json(msg).dump();
+        bytes = data.size();
+        benchmark::DoNotOptimize(data.data());
+    }
+    counter.finish(bytes);
+}
+BENCHMARK(BM_RobotStateJson);
+
+static void BM_RobotStateBson(benchmark::State &state) {
+    const auto msg = make_robot_state(100.0);
+    size_t bytes = 0;
+    AllocationCounter counter(state);
+    for (auto _: state) {
+        json data;
+        data["d"] = robot_state_to_json(msg);
+        auto bson = json::to_bson(data);
+        bytes = bson.size();
+        benchmark::DoNotOptimize(bson.data());
+    }
+    counter.finish(bytes);
+}
+BENCHMARK(BM_RobotStateBson);
+
+static void BM_RobotPose(benchmark::State &state) {
+    const auto msg = make_robot_state(100.0);
+    uint16_t seq = 0;
+    size_t bytes = 0;
+    AllocationCounter counter(state);
+    for (auto _: state) {
+        BinaryWriter w;
+        encode_robot_pose(msg, seq++, w);
+        bytes = w.size();
+        benchmark::DoNotOptimize(w.data().data());
+    }
+    counter.finish(bytes);
+}
+BENCHMARK(BM_RobotPose);
+
+static void BM_SensorMetadata(benchmark::State &state) {
+    std::vector<xbot_msgs::SensorInfo> infos;
+    for (int i = 0; i < state.range(0); i++) {
+        infos.push_back(make_sensor_info(i));
+    }
+    size_t bytes = 0;
+    AllocationCounter counter(state);
+    for (auto _: state) {
+        json sensor_info;
+        for (const auto &info: infos) {
+            sensor_info.push_back(sensor_info_to_json(info));
+        }
+        auto data = sensor_info.dump();
+        json wrapped;
+        wrapped["d"] = std::move(sensor_info);
+        auto bson = json::to_bson(wrapped);
+        bytes = data.size() + bson.size();
+        benchmark::DoNotOptimize(bson.data());
+    }
+    counter.finish(bytes);
+}
+BENCHMARK(BM_SensorMetadata)->RangeMultiplier(4)->Range(1, 256);
+
+static void BM_Map(benchmark::State &state) {
+    const auto msg = map_with_points(static_cast<int>(state.range(0)));
+    size_t bytes = 0;
+    AllocationCounter counter(state);
+    for (auto _: state) {
+        json wrapped;
+        wrapped["d"] = map_to_json(msg);
+        auto bson = json::to_bson(wrapped);
+        bytes = bson.size();
+        benchmark::DoNotOptimize(bson.data());
+    }
+    counter.finish(bytes);
+}
+BENCHMARK(BM_Map)->RangeMultiplier(10)->Range(100, 100000);
+
+static void BM_MapPolygons(benchmark::State &state) {
+    const auto msg = map_with_points(static_cast<int>(state.range(0)));
+    AllocationCounter counter(state);
+    for (auto _: state) {
+        auto polygons = map_polygons(msg);
+        benchmark::DoNotOptimize(polygons.data());
+    }
+    counter.finish();
+}
+BENCHMARK(BM_MapPolygons)->RangeMultiplier(10)->Range(100, 100000);
+
+static void BM_MapOverlay(benchmark::State &state) {
+    const auto msg = map_overlay_with_points(static_cast<int>(state.range(0)));
+    size_t bytes = 0;
+    AllocationCounter counter(state);
+    for (auto _: state) {
+        json wrapped;
+        wrapped["d"] = map_overlay_to_json(msg);
+        auto bson = json::to_bson(wrapped);
+        bytes = bson.size();
+        benchmark::DoNotOptimize(bson.data());
+    }
+    counter.finish(bytes);
+}
+BENCHMARK(BM_MapOverlay)->RangeMultiplier(10)->Range(100, 100000);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,230 @@
+#include "xbot_monitoring/history_log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "ros/console.h"
+
+// Maximum number of records waiting for the writer thread
+#define MAX_QUEUED_RECORDS 65536
+// Free records a segment has at least after its channel definitions
+#define MIN_FREE_RECORDS 16
+// Seconds between attempts to open a segment after opening one failed
+#define OPEN_RETRY_INTERVAL 1.0
+
+HistoryLog::HistoryLog(std::string directory, size_t segment_size, size_t max_segments)
+        : directory_(std::move(directory)),
+          segment_size_(std::max<size_t>(segment_size, sizeof(LogSegmentHeader) + MIN_FREE_RECORDS * sizeof(LogRecord))),
+          max_segments_(std::max<size_t>(max_segments, 1)) {
+}
+
+HistoryLog::~HistoryLog() {
+    stop();
+}
+
+std::string HistoryLog::segment_path(const std::string &directory, uint64_t index) {
+    char name[64];
+    snprintf(name, sizeof(name), "segment_%010llu.xlog", static_cast<unsigned long long>(index));
+    return (std::filesystem::path(directory) / name).string();
+}
+
+bool HistoryLog::start() {
+    std::error_code ec;
+    std::filesystem::create_directories(directory_, ec);
+    if (ec) {
+        ROS_ERROR_STREAM("Could not create history log directory " << directory_ << ": " << ec.message());
+        return false;
+    }
+
+    // Continue after the newest existing segment
+    for (const auto &entry: std::filesystem::directory_iterator(directory_, ec)) {
+        unsigned long long index;
+        if (sscanf(entry.path().filename().c_str(), "segment_%llu.xlog", &index) == 1) {
+            next_segment_index_ = std::max<uint64_t>(next_segment_index_, index + 1);
+        }
+    }
+
+    if (!open_segment())
+        return false;
+
+    running_ = true;
+    writer_thread_ = std::thread(&HistoryLog::run, this);
+    return true;
+}
+
+void HistoryLog::stop() {
+    if (running_.exchange(false)) {
+        queue_cv_.notify_all();
+        writer_thread_.join();
+    }
+    close_segment();
+}
+
+uint16_t HistoryLog::channel(const std::string &name) {
+    uint16_t id;
+    {
+        std::unique_lock<std::mutex> lk(channels_mutex_);
+        auto it = std::find(channels_.begin(), channels_.end(), name);
+        if (it != channels_.end())
+            return static_cast<uint16_t>(it - channels_.begin());
+        id = static_cast<uint16_t>(channels_.size());
+        channels_.push_back(name);
+    }
+
+    LogRecord record{};
+    record.type = LOG_RECORD_CHANNEL;
+    record.channel = id;
+    set_text(record, name);
+    append(record);
+    return id;
+}
+
+void HistoryLog::append(const LogRecord &record) {
+    {
+        std::unique_lock<std::mutex> lk(queue_mutex_);
+        if (queue_.size() >= MAX_QUEUED_RECORDS) {
+            dropped_++;
+            return;
+        }
+        queue_.push_back(record);
+    }
+    queue_cv_.notify_one();
+}
+
+void HistoryLog::set_text(LogRecord &record, const std::string &text) {
+    const size_t len = std::min(text.size(), sizeof(record.text) - 1);
+    memcpy(record.text, text.data(), len);
+    record.text[len] = 0;
+}
+
+void HistoryLog::run() {
+    std::vector<LogRecord> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lk(queue_mutex_);
+            queue_cv_.wait(lk, [this] { return !queue_.empty() || !running_; });
+            if (queue_.empty() && !running_)
+                break;
+            batch.swap(queue_);
+        }
+
+        for (const auto &record: batch) {
+            write_record(record);
+        }
+        batch.clear();
+    }
+}
+
+void HistoryLog::write_record(const LogRecord &record) {
+    if (header_ != nullptr && header_->record_count >= header_->capacity)
+        close_segment();
+
+    if (header_ == nullptr) {
+        // Opening the segment failed before, e.g. on a full disk. Retry, but don't hammer the disk on every record.
+        const auto now = std::chrono::steady_clock::now();
+        if (now < next_open_attempt_ || !open_segment()) {
+            if (now >= next_open_attempt_)
+                next_open_attempt_ = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>(OPEN_RETRY_INTERVAL));
+            dropped_++;
+            return;
+        }
+    }
+
+    LogRecord &target = records_[header_->record_count];
+    target = record;
+    // Channel definitions are repeated per segment, zero stamps would look like the end of the log
+    if (target.stamp_ns == 0)
+        target.stamp_ns = 1;
+    header_->record_count++;
+}
+
+bool HistoryLog::open_segment() {
+    const std::string path = segment_path(directory_, next_segment_index_);
+    std::vector<std::string> channels;
+    {
+        std::unique_lock<std::mutex> lk(channels_mutex_);
+        channels = channels_;
+    }
+    // Grow the segment beyond segment_size_ if needed, so that it always fits all channel definitions and some data
+    mapped_size_ = std::max(segment_size_,
+                            sizeof(LogSegmentHeader) + (channels.size() + MIN_FREE_RECORDS) * sizeof(LogRecord));
+
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        ROS_ERROR_STREAM_THROTTLE(10.0, "Could not open history log segment " << path << ": " << strerror(errno));
+        return false;
+    }
+
+    // Reserve the blocks up front, writing into a sparse mapping on a full disk would SIGBUS.
+    int err = posix_fallocate(fd_, 0, static_cast<off_t>(mapped_size_));
+    if (err != 0) {
+        ROS_ERROR_STREAM_THROTTLE(10.0, "Could not allocate history log segment " << path << ": " << strerror(err));
+        close(fd_);
+        fd_ = -1;
+        unlink(path.c_str());
+        return false;
+    }
+
+    void *mapping = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapping == MAP_FAILED) {
+        ROS_ERROR_STREAM_THROTTLE(10.0, "Could not map history log segment " << path << ": " << strerror(errno));
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    header_ = static_cast<LogSegmentHeader *>(mapping);
+    records_ = reinterpret_cast<LogRecord *>(static_cast<char *>(mapping) + sizeof(LogSegmentHeader));
+
+    memcpy(header_->magic, XBOT_LOG_MAGIC, sizeof(header_->magic));
+    header_->version = XBOT_LOG_VERSION;
+    header_->record_size = sizeof(LogRecord);
+    header_->capacity = (mapped_size_ - sizeof(LogSegmentHeader)) / sizeof(LogRecord);
+    header_->record_count = 0;
+    header_->segment_index = next_segment_index_;
+    next_segment_index_++;
+
+    // Make the segment self-contained
+    for (size_t i = 0; i < channels.size(); i++) {
+        LogRecord &record = records_[header_->record_count++];
+        record.stamp_ns = 1;
+        record.type = LOG_RECORD_CHANNEL;
+        record.channel = static_cast<uint16_t>(i);
+        set_text(record, channels[i]);
+    }
+
+    remove_old_segments();
+    return true;
+}
+
+void HistoryLog::close_segment() {
+    if (header_ != nullptr) {
+        // Let the kernel write back in its own time, we don't want to stall on the SD card here.
+        msync(header_, mapped_size_, MS_ASYNC);
+        munmap(header_, mapped_size_);
+        header_ = nullptr;
+        records_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+void HistoryLog::remove_old_segments() {
+    // Segments [next_segment_index_ - max_segments_, next_segment_index_) are kept
+    std::error_code ec;
+    for (const auto &entry: std::filesystem::directory_iterator(directory_, ec)) {
+        unsigned long long index;
+        if (sscanf(entry.path().filename().c_str(), "segment_%llu.xlog", &index) == 1 &&
+            index + max_segments_ < next_segment_index_) {
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+}
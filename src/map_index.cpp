@@ -0,0 +1,110 @@
+#include "xbot_monitoring/map_index.h"
+
+// Max polygons per leaf
+#define MAX_LEAF_SIZE 4
+
+MapIndex::MapIndex(std::vector<MapPolygon> polygons) : polygons_(std::move(polygons)) {
+    for (auto &polygon: polygons_) {
+        polygon.bounds = polygon_bounds(polygon.points);
+    }
+    for (int i = 0; i < static_cast<int>(polygons_.size()); i++) {
+        if (polygons_[i].points.size() >= 3)
+            order_.push_back(i);
+    }
+    if (!order_.empty()) {
+        nodes_.reserve(2 * order_.size());
+        build(0, static_cast<int>(order_.size()));
+    }
+}
+
+int MapIndex::build(int first, int count) {
+    const int index = static_cast<int>(nodes_.size());
+    nodes_.emplace_back();
+
+    BoundingBox bounds, centers;
+    for (int i = first; i < first + count; i++) {
+        bounds.extend(polygons_[order_[i]].bounds);
+        centers.extend(polygons_[order_[i]].bounds.center());
+    }
+    nodes_[index].bounds = bounds;
+
+    if (count <= MAX_LEAF_SIZE) {
+        nodes_[index].first = first;
+        nodes_[index].count = count;
+        return index;
+    }
+
+    // Median split along the longer axis of the centers
+    const bool split_x = centers.max_x - centers.min_x >= centers.max_y - centers.min_y;
+    const int half = count / 2;
+    std::nth_element(order_.begin() + first, order_.begin() + first + half, order_.begin() + first + count,
+                     [this, split_x](int a, int b) {
+                         const Point2 ca = polygons_[a].bounds.center();
+                         const Point2 cb = polygons_[b].bounds.center();
+                         return split_x ? ca.x < cb.x : ca.y < cb.y;
+                     });
+
+    const int left = build(first, half);
+    const int right = build(first + half, count - half);
+    nodes_[index].left = left;
+    nodes_[index].right = right;
+    return index;
+}
+
+std::vector<const MapPolygon *> MapIndex::containing(const Point2 &p) const {
+    std::vector<const MapPolygon *> result;
+    if (nodes_.empty())
+        return result;
+
+    std::vector<int> stack{0};
+    while (!stack.empty()) {
+        const Node &node = nodes_[stack.back()];
+        stack.pop_back();
+        if (!node.bounds.contains(p))
+            continue;
+        if (node.left < 0) {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                const auto &polygon = polygons_[order_[i]];
+                if (polygon.bounds.contains(p) && point_in_polygon(p, polygon.points))
+                    result.push_back(&polygon);
+            }
+        } else {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+    return result;
+}
+
+const MapPolygon *MapIndex::nearest_obstacle(const Point2 &p, double max_distance, double &distance) const {
+    const MapPolygon *nearest = nullptr;
+    distance = max_distance;
+    if (nodes_.empty())
+        return nullptr;
+
+    std::vector<int> stack{0};
+    while (!stack.empty()) {
+        const Node &node = nodes_[stack.back()];
+        stack.pop_back();
+        if (node.bounds.distance(p) > distance)
+            continue;
+        if (node.left < 0) {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                const auto &polygon = polygons_[order_[i]];
+                if (polygon.type != MapPolygonType::OBSTACLE || polygon.bounds.distance(p) > distance)
+                    continue;
+                const double d = point_in_polygon(p, polygon.points) ? 0.0 : point_polygon_distance(p, polygon.points);
+                if (d <= distance) {
+                    distance = d;
+                    nearest = &polygon;
+                }
+            }
+        } else {
+            // Visit the closer child first (it's popped last), so that the other one can be pruned more often
+            const bool left_closer = nodes_[node.left].bounds.distance(p) <= nodes_[node.right].bounds.distance(p);
+            stack.push_back(left_closer ? node.right : node.left);
+            stack.push_back(left_closer ? node.left : node.right);
+        }
+    }
+    return nearest;
+}
@@ -0,0 +1,160 @@
+#include "xbot_monitoring/map_tiles.h"
+
+#include <cmath>
+
+static int tile_coordinate(double value, double tile_size) {
+    const double index = std::floor(value / tile_size);
+    // Also catches NaN from a broken tile size
+    if (!(index >= -TILE_KEY_LIMIT))
+        return -TILE_KEY_LIMIT;
+    if (index > TILE_KEY_LIMIT)
+        return TILE_KEY_LIMIT;
+    return static_cast<int>(index);
+}
+
+TileKey TileGrid::key(const Point2 &p) const {
+    return {tile_coordinate(p.x, tile_size_), tile_coordinate(p.y, tile_size_)};
+}
+
+BoundingBox TileGrid::tile_bounds(const TileKey &key) const {
+    BoundingBox bounds;
+    bounds.min_x = key.x * tile_size_;
+    bounds.min_y = key.y * tile_size_;
+    bounds.max_x = (key.x + 1) * tile_size_;
+    bounds.max_y = (key.y + 1) * tile_size_;
+    return bounds;
+}
+
+size_t TileGrid::tile_count(const BoundingBox &bounds) const {
+    if (bounds.empty())
+        return 0;
+    const TileKey min = key({bounds.min_x, bounds.min_y});
+    const TileKey max = key({bounds.max_x, bounds.max_y});
+    return static_cast<size_t>(max.x - min.x + 1) * static_cast<size_t>(max.y - min.y + 1);
+}
+
+std::vector<TileKey> TileGrid::tiles(const BoundingBox &bounds) const {
+    std::vector<TileKey> result;
+    if (bounds.empty())
+        return result;
+    const TileKey min = key({bounds.min_x, bounds.min_y});
+    const TileKey max = key({bounds.max_x, bounds.max_y});
+    for (int y = min.y; y <= max.y; y++) {
+        for (int x = min.x; x <= max.x; x++) {
+            result.push_back({x, y});
+        }
+    }
+    return result;
+}
+
+std::vector<Point2> finite_points(const std::vector<Point2> &points) {
+    std::vector<Point2> result;
+    result.reserve(points.size());
+    for (const auto &p: points) {
+        if (std::isfinite(p.x) && std::isfinite(p.y))
+            result.push_back(p);
+    }
+    return result;
+}
+
+// Clips against a single edge. axis 0 = x, 1 = y. keep_greater selects which side of value is inside.
+static std::vector<Point2> clip_edge(const std::vector<Point2> &input, int axis, double value, bool keep_greater) {
+    std::vector<Point2> output;
+    if (input.empty())
+        return output;
+    output.reserve(input.size() + 4);
+
+    const auto coord = [axis](const Point2 &p) { return axis == 0 ? p.x : p.y; };
+    const auto inside = [&](const Point2 &p) { return keep_greater ? coord(p) >= value : coord(p) <= value; };
+    const auto intersect = [&](const Point2 &a, const Point2 &b) {
+        const double t = (value - coord(a)) / (coord(b) - coord(a));
+        return Point2{a.x + t * (b.x - a.x), a.y + t * (b.y - a.y)};
+    };
+
+    Point2 previous = input.back();
+    bool previous_inside = inside(previous);
+    for (const auto &current: input) {
+        const bool current_inside = inside(current);
+        if (current_inside) {
+            if (!previous_inside)
+                output.push_back(intersect(previous, current));
+            output.push_back(current);
+        } else if (previous_inside) {
+            output.push_back(intersect(previous, current));
+        }
+        previous = current;
+        previous_inside = current_inside;
+    }
+    return output;
+}
+
+std::vector<Point2> clip_polygon(const std::vector<Point2> &polygon, const BoundingBox &box) {
+    std::vector<Point2> result = clip_edge(polygon, 0, box.min_x, true);
+    result = clip_edge(result, 0, box.max_x, false);
+    result = clip_edge(result, 1, box.min_y, true);
+    result = clip_edge(result, 1, box.max_y, false);
+    if (result.size() < 3)
+        result.clear();
+    return result;
+}
+
+// Liang-Barsky, returns false if the segment a-b is outside the box. Otherwise a and b are clipped in place.
+static bool clip_segment(Point2 &a, Point2 &b, const BoundingBox &box) {
+    const double dx = b.x - a.x;
+    const double dy = b.y - a.y;
+    const double p[4] = {-dx, dx, -dy, dy};
+    const double q[4] = {a.x - box.min_x, box.max_x - a.x, a.y - box.min_y, box.max_y - a.y};
+    double t0 = 0, t1 = 1;
+    for (int i = 0; i < 4; i++) {
+        if (p[i] == 0) {
+            if (q[i] < 0)
+                return false;
+            continue;
+        }
+        const double t = q[i] / p[i];
+        if (p[i] < 0) {
+            t0 = std::max(t0, t);
+        } else {
+            t1 = std::min(t1, t);
+        }
+        if (t0 > t1)
+            return false;
+    }
+    const Point2 start{a.x + t0 * dx, a.y + t0 * dy};
+    b = {a.x + t1 * dx, a.y + t1 * dy};
+    a = start;
+    return true;
+}
+
+std::vector<std::vector<Point2>> clip_polyline(const std::vector<Point2> &polyline, const BoundingBox &box) {
+    std::vector<std::vector<Point2>> pieces;
+    std::vector<Point2> current;
+    for (size_t i = 1; i < polyline.size(); i++) {
+        Point2 a = polyline[i - 1];
+        Point2 b = polyline[i];
+        if (!clip_segment(a, b, box)) {
+            if (current.size() >= 2)
+                pieces.push_back(std::move(current));
+            current.clear();
+            continue;
+        }
+        if (current.empty()) {
+            current.push_back(a);
+        } else if (current.back().x != a.x || current.back().y != a.y) {
+            // The line left the box and came back in
+            if (current.size() >= 2)
+                pieces.push_back(std::move(current));
+            current.clear();
+            current.push_back(a);
+        }
+        current.push_back(b);
+        // Clipped at the end, the next segment starts outside
+        if (b.x != polyline[i].x || b.y != polyline[i].y) {
+            pieces.push_back(std::move(current));
+            current.clear();
+        }
+    }
+    if (current.size() >= 2)
+        pieces.push_back(std::move(current));
+    return pieces;
+}
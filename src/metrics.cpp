@@ -0,0 +1,173 @@
+#include "xbot_monitoring/metrics.h"
+
+#include <algorithm>
+#include <sstream>
+#include <unordered_map>
+
+MetricsRegistry &metrics() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::MetricsRegistry() {
+    // Family 0 collects everything which doesn't fit anymore
+    family("other");
+}
+
+int MetricsRegistry::family(const std::string &name) {
+    std::unique_lock<std::mutex> lk(mutex_);
+    auto it = std::find(families_.begin(), families_.end(), name);
+    if (it != families_.end())
+        return static_cast<int>(it - families_.begin());
+    if (families_.size() >= MAX_FAMILIES)
+        return 0;
+
+    const int id = static_cast<int>(families_.size());
+    families_.push_back(name);
+    for (auto &timing: timings_[id]) {
+        timing = std::make_unique<LatencyHistogram>();
+    }
+    return id;
+}
+
+int MetricsRegistry::topic_family(const std::string &topic) {
+    // Only the process wide registry is cached, others always take the lock
+    thread_local std::unordered_map<std::string, int> cache;
+    thread_local std::string first_level;
+
+    const size_t start = topic.size() > 1 && topic[0] == '/' ? 1 : 0;
+    first_level.assign(topic, start, topic.find('/', start) - start);
+    if (this != &metrics())
+        return family(first_level);
+
+    auto it = cache.find(first_level);
+    if (it != cache.end())
+        return it->second;
+    const int id = family(first_level);
+    cache.emplace(first_level, id);
+    return id;
+}
+
+MetricsRegistry::Shard &MetricsRegistry::local_shard() {
+    // Usually there is only the process wide registry, so this is a single comparison
+    thread_local std::vector<std::pair<const MetricsRegistry *, Shard *>> shards;
+    for (const auto &kv: shards) {
+        if (kv.first == this)
+            return *kv.second;
+    }
+
+    // Shards live as long as the registry, so counts of finished threads are kept
+    std::unique_lock<std::mutex> lk(mutex_);
+    shards_.push_back(std::make_unique<Shard>());
+    shards.emplace_back(this, shards_.back().get());
+    return *shards_.back();
+}
+
+void MetricsRegistry::add(int family, MetricCounter counter, uint64_t value) {
+    if (family < 0 || family >= MAX_FAMILIES)
+        family = 0;
+    // Only this thread writes to the shard, so a plain load and store is enough
+    auto &c = local_shard().counters[family][static_cast<int>(counter)];
+    c.store(c.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void MetricsRegistry::record(int family, MetricTiming timing, uint64_t ns) {
+    if (family < 0 || family >= MAX_FAMILIES || !timings_[family][0])
+        family = 0;
+    timings_[family][static_cast<int>(timing)]->record(ns);
+}
+
+std::vector<MetricsRegistry::FamilySnapshot> MetricsRegistry::snapshot() const {
+    std::unique_lock<std::mutex> lk(mutex_);
+    std::vector<FamilySnapshot> result(families_.size());
+    for (size_t f = 0; f < families_.size(); f++) {
+        auto &family = result[f];
+        family.name = families_[f];
+        for (int c = 0; c < COUNTER_COUNT; c++) {
+            family.counters[c] = 0;
+            for (const auto &shard: shards_) {
+                family.counters[c] += shard->counters[f][c].load(std::memory_order_relaxed);
+            }
+        }
+        for (int t = 0; t < TIMING_COUNT; t++) {
+            family.timings[t] = timings_[f][t]->snapshot();
+        }
+    }
+    return result;
+}
+
+const char *metric_name(MetricCounter counter) {
+    switch (counter) {
+        case MetricCounter::MESSAGES_IN: return "messages_in";
+        case MetricCounter::BYTES_IN: return "bytes_in";
+        case MetricCounter::MESSAGES_OUT: return "messages_out";
+        case MetricCounter::BYTES_OUT: return "bytes_out";
+        case MetricCounter::BUFFERED: return "buffered";
+        case MetricCounter::DROPS: return "drops";
+        case MetricCounter::EXCEPTIONS: return "exceptions";
+        default: return "unknown";
+    }
+}
+
+const char *metric_name(MetricTiming timing) {
+    switch (timing) {
+        case MetricTiming::ENCODE: return "encode";
+        case MetricTiming::QUEUE_DELAY: return "queue_delay";
+        default: return "unknown";
+    }
+}
+
+namespace {
+// Family names come from topics, which may contain anything
+std::string escape_label(const std::string &value) {
+    std::string result;
+    result.reserve(value.size());
+    for (char c: value) {
+        if (c == '\\' || c == '"') {
+            result += '\\';
+            result += c;
+        } else if (c == '\n') {
+            result += "\\n";
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+}
+
+std::string prometheus_text(const std::vector<MetricsRegistry::FamilySnapshot> &snapshot) {
+    static const double QUANTILES[] = {0.5, 0.9, 0.99};
+    std::ostringstream out;
+
+    std::vector<std::string> labels;
+    for (const auto &family: snapshot) {
+        labels.push_back(escape_label(family.name));
+    }
+
+    for (int c = 0; c < MetricsRegistry::COUNTER_COUNT; c++) {
+        const std::string name = std::string("xbot_monitoring_") + metric_name(static_cast<MetricCounter>(c)) + "_total";
+        out << "# TYPE " << name << " counter\n";
+        for (size_t f = 0; f < snapshot.size(); f++) {
+            out << name << "{family=\"" << labels[f] << "\"} " << snapshot[f].counters[c] << "\n";
+        }
+    }
+
+    for (int t = 0; t < MetricsRegistry::TIMING_COUNT; t++) {
+        const std::string name = std::string("xbot_monitoring_") + metric_name(static_cast<MetricTiming>(t)) + "_seconds";
+        out << "# TYPE " << name << " summary\n";
+        for (size_t f = 0; f < snapshot.size(); f++) {
+            const auto &timing = snapshot[f].timings[t];
+            // Families without samples would only add noise
+            if (timing.count == 0)
+                continue;
+            for (double q: QUANTILES) {
+                out << name << "{family=\"" << labels[f] << "\",quantile=\"" << q << "\"} "
+                    << static_cast<double>(timing.percentile(q)) * 1e-9 << "\n";
+            }
+            out << name << "_sum{family=\"" << labels[f] << "\"} " << static_cast<double>(timing.sum) * 1e-9 << "\n";
+            out << name << "_count{family=\"" << labels[f] << "\"} " << timing.count << "\n";
+        }
+    }
+    return out.str();
+}
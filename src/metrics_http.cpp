@@ -0,0 +1,106 @@
+#include "xbot_monitoring/metrics_http.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstring>
+
+MetricsHttpServer::~MetricsHttpServer() {
+    stop();
+}
+
+bool MetricsHttpServer::start(const std::string &address, int port, BodyCallback body) {
+    if (running_)
+        return false;
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1)
+        return false;
+
+    socket_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket_ < 0)
+        return false;
+    int reuse = 1;
+    setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(socket_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(socket_, 4) != 0) {
+        ::close(socket_);
+        socket_ = -1;
+        return false;
+    }
+
+    body_ = std::move(body);
+    running_ = true;
+    thread_ = std::thread(&MetricsHttpServer::run, this);
+    return true;
+}
+
+void MetricsHttpServer::stop() {
+    if (!running_)
+        return;
+    running_ = false;
+    if (thread_.joinable())
+        thread_.join();
+    ::close(socket_);
+    socket_ = -1;
+}
+
+void MetricsHttpServer::run() {
+    pollfd pfd{};
+    pfd.fd = socket_;
+    pfd.events = POLLIN;
+    while (running_) {
+        // Wake up regularly to check whether we should stop
+        if (poll(&pfd, 1, 500) <= 0)
+            continue;
+        const int connection = accept4(socket_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connection < 0)
+            continue;
+        // Don't let a stuck client block the server
+        timeval timeout{};
+        timeout.tv_sec = 2;
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        handle(connection);
+        ::close(connection);
+    }
+}
+
+void MetricsHttpServer::handle(int connection) {
+    // Only the request line is of interest, read until the end of the headers
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+        const ssize_t n = recv(connection, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+            return;
+        request.append(buffer, static_cast<size_t>(n));
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 13, "GET /metrics?") == 0) {
+        body = body_();
+    } else if (request.compare(0, 4, "GET ") != 0) {
+        status = "405 Method Not Allowed";
+    } else {
+        status = "404 Not Found";
+    }
+
+    std::string response = "HTTP/1.1 " + status + "\r\n"
+                           "Content-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n" + body;
+    size_t sent = 0;
+    while (sent < response.size()) {
+        const ssize_t n = send(connection, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return;
+        sent += static_cast<size_t>(n);
+    }
+}
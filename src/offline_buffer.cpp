@@ -0,0 +1,196 @@
+#include "xbot_monitoring/offline_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+
+#include "ros/console.h"
+
+OfflineBuffer::OfflineBuffer(Mode mode, size_t max_bytes, std::string spill_path, size_t max_spill_bytes)
+        : mode_(mode), max_bytes_(max_bytes), spill_path_(std::move(spill_path)), max_spill_bytes_(max_spill_bytes) {
+    if (mode_ == Mode::ORDERED && !spill_path_.empty()) {
+        spill_file_ = fopen(spill_path_.c_str(), "w+b");
+        if (spill_file_ == nullptr) {
+            ROS_ERROR_STREAM("Could not open offline buffer spill file " << spill_path_ << ": " << strerror(errno));
+        }
+    }
+}
+
+OfflineBuffer::~OfflineBuffer() {
+    if (spill_file_ != nullptr) {
+        fclose(spill_file_);
+        remove(spill_path_.c_str());
+    }
+}
+
+void OfflineBuffer::push(const std::string &topic, const void *data, size_t size) {
+    std::unique_lock<std::mutex> lk(mutex_);
+
+    if (mode_ == Mode::LATEST) {
+        auto it = latest_.find(topic);
+        if (it != latest_.end()) {
+            if (bytes_ - it->second.size() + size <= max_bytes_) {
+                bytes_ -= it->second.size();
+                it->second.assign(static_cast<const char *>(data), size);
+                bytes_ += size;
+            } else {
+                // The old value is outdated now, so drop the topic rather than replaying it
+                bytes_ -= it->first.size() + it->second.size();
+                latest_.erase(it);
+                dropped_++;
+                ROS_WARN_STREAM_THROTTLE(1.0, "Offline buffer full, dropping " << topic);
+            }
+        } else if (bytes_ + topic.size() + size <= max_bytes_) {
+            latest_.emplace(topic, std::string(static_cast<const char *>(data), size));
+            bytes_ += topic.size() + size;
+        } else {
+            dropped_++;
+            ROS_WARN_STREAM_THROTTLE(1.0, "Offline buffer full, dropping " << topic);
+        }
+        return;
+    }
+
+    messages_.push_back({topic, std::string(static_cast<const char *>(data), size)});
+    bytes_ += topic.size() + size;
+    while (bytes_ > max_bytes_ && !messages_.empty()) {
+        if (!spill_oldest()) {
+            // No room on disk either, drop the oldest
+            ROS_WARN_STREAM_THROTTLE(1.0, "Offline buffer full, dropping the oldest message on "
+                                          << messages_.front().topic);
+            bytes_ -= messages_.front().topic.size() + messages_.front().payload.size();
+            messages_.pop_front();
+            dropped_++;
+        }
+    }
+}
+
+bool OfflineBuffer::pop(BufferedMessage &out) {
+    std::unique_lock<std::mutex> lk(mutex_);
+
+    if (mode_ == Mode::LATEST) {
+        if (latest_.empty())
+            return false;
+        auto it = latest_.begin();
+        out.topic = it->first;
+        out.payload = std::move(it->second);
+        bytes_ -= out.topic.size() + out.payload.size();
+        latest_.erase(it);
+        return true;
+    }
+
+    // Spilled messages are older than everything in memory
+    if (spilled_count_ > 0 && read_spilled(out))
+        return true;
+
+    if (messages_.empty())
+        return false;
+    out = std::move(messages_.front());
+    messages_.pop_front();
+    bytes_ -= out.topic.size() + out.payload.size();
+    return true;
+}
+
+bool OfflineBuffer::empty() const {
+    return size() == 0;
+}
+
+size_t OfflineBuffer::size() const {
+    std::unique_lock<std::mutex> lk(mutex_);
+    return mode_ == Mode::LATEST ? latest_.size() : messages_.size() + spilled_count_;
+}
+
+uint64_t OfflineBuffer::dropped() const {
+    std::unique_lock<std::mutex> lk(mutex_);
+    return dropped_;
+}
+
+bool OfflineBuffer::spill_oldest() {
+    if (spill_file_ == nullptr)
+        return false;
+
+    const auto &msg = messages_.front();
+    const uint32_t lengths[2] = {static_cast<uint32_t>(msg.topic.size()), static_cast<uint32_t>(msg.payload.size())};
+    const size_t record_size = sizeof(lengths) + msg.topic.size() + msg.payload.size();
+    if (static_cast<size_t>(spill_write_offset_) + record_size > max_spill_bytes_) {
+        // The file only shrinks when it's read back completely, so reclaim the read part once it's worth the copy
+        if (static_cast<size_t>(spill_read_offset_) < max_spill_bytes_ / 4 || !compact_spill_file())
+            return false;
+        if (static_cast<size_t>(spill_write_offset_) + record_size > max_spill_bytes_)
+            return false;
+    }
+
+    if (fseek(spill_file_, spill_write_offset_, SEEK_SET) != 0 ||
+        fwrite(lengths, sizeof(lengths), 1, spill_file_) != 1 ||
+        fwrite(msg.topic.data(), 1, msg.topic.size(), spill_file_) != msg.topic.size() ||
+        fwrite(msg.payload.data(), 1, msg.payload.size(), spill_file_) != msg.payload.size()) {
+        return false;
+    }
+    spill_write_offset_ += static_cast<long>(record_size);
+    spilled_count_++;
+
+    bytes_ -= msg.topic.size() + msg.payload.size();
+    messages_.pop_front();
+    return true;
+}
+
+bool OfflineBuffer::compact_spill_file() {
+    char buffer[64 * 1024];
+    long from = spill_read_offset_;
+    long to = 0;
+    fflush(spill_file_);
+    while (from < spill_write_offset_) {
+        const size_t n = std::min(sizeof(buffer), static_cast<size_t>(spill_write_offset_ - from));
+        if (fseek(spill_file_, from, SEEK_SET) != 0 || fread(buffer, 1, n, spill_file_) != n ||
+            fseek(spill_file_, to, SEEK_SET) != 0 || fwrite(buffer, 1, n, spill_file_) != n) {
+            // Half moved records are useless, give up on the file's contents
+            ROS_ERROR_STREAM("Could not compact offline buffer spill file " << spill_path_ << ", dropping "
+                             << spilled_count_ << " messages");
+            dropped_ += spilled_count_;
+            spilled_count_ = 0;
+            spill_read_offset_ = 0;
+            spill_write_offset_ = 0;
+            spill_file_ = freopen(spill_path_.c_str(), "w+b", spill_file_);
+            return false;
+        }
+        from += static_cast<long>(n);
+        to += static_cast<long>(n);
+    }
+    fflush(spill_file_);
+    if (ftruncate(fileno(spill_file_), to) != 0) {
+        ROS_ERROR_STREAM("Could not truncate offline buffer spill file " << spill_path_ << ": " << strerror(errno));
+    }
+    spill_read_offset_ = 0;
+    spill_write_offset_ = to;
+    return true;
+}
+
+bool OfflineBuffer::read_spilled(BufferedMessage &out) {
+    uint32_t lengths[2];
+    fflush(spill_file_);
+    bool ok = fseek(spill_file_, spill_read_offset_, SEEK_SET) == 0 &&
+              fread(lengths, sizeof(lengths), 1, spill_file_) == 1;
+    if (ok) {
+        out.topic.resize(lengths[0]);
+        out.payload.resize(lengths[1]);
+        ok = fread(&out.topic[0], 1, lengths[0], spill_file_) == lengths[0] &&
+             fread(&out.payload[0], 1, lengths[1], spill_file_) == lengths[1];
+    }
+    if (ok) {
+        spill_read_offset_ += static_cast<long>(sizeof(lengths) + lengths[0] + lengths[1]);
+        spilled_count_--;
+    } else {
+        // The spill file is broken, give up on its contents
+        ROS_ERROR_STREAM("Could not read offline buffer spill file " << spill_path_ << ", dropping "
+                         << spilled_count_ << " messages");
+        dropped_ += spilled_count_;
+        spilled_count_ = 0;
+    }
+
+    if (spilled_count_ == 0) {
+        // Everything was read back, start over with an empty file
+        spill_read_offset_ = 0;
+        spill_write_offset_ = 0;
+        spill_file_ = freopen(spill_path_.c_str(), "w+b", spill_file_);
+    }
+    return ok;
+}
@@ -0,0 +1,48 @@
+#include "xbot_monitoring/process_stats.h"
+
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+bool read_process_stats(ProcessStats &stats) {
+    std::ifstream stat_file("/proc/self/stat");
+    std::string stat;
+    if (!std::getline(stat_file, stat))
+        return false;
+
+    // The process name may contain spaces and parentheses, the fields we want come after the last ')'
+    const size_t name_end = stat.rfind(')');
+    if (name_end == std::string::npos)
+        return false;
+    std::istringstream fields(stat.substr(name_end + 2));
+
+    // Starting at field 3 (state), utime and stime are fields 14 and 15, num_threads is field 20
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+    long threads = 0;
+    for (int i = 3; i <= 20 && fields >> field; i++) {
+        if (i == 14) {
+            utime = std::stoull(field);
+        } else if (i == 15) {
+            stime = std::stoull(field);
+        } else if (i == 20) {
+            threads = std::stol(field);
+        }
+    }
+    if (!fields)
+        return false;
+
+    std::ifstream statm_file("/proc/self/statm");
+    unsigned long long size_pages = 0, resident_pages = 0;
+    if (!(statm_file >> size_pages >> resident_pages))
+        return false;
+
+    static const long ticks_per_second = sysconf(_SC_CLK_TCK);
+    static const long page_size = sysconf(_SC_PAGESIZE);
+    stats.cpu_time = static_cast<double>(utime + stime) / static_cast<double>(ticks_per_second);
+    stats.rss_bytes = resident_pages * static_cast<unsigned long long>(page_size);
+    stats.threads = static_cast<int>(threads);
+    return true;
+}
@@ -0,0 +1,74 @@
+#include "xbot_monitoring/sensor_history.h"
+
+#include <algorithm>
+#include <cstdint>
+
+// Stops at the highest power of two instead of overflowing
+static size_t next_power_of_two(size_t v) {
+    size_t p = 1;
+    while (p < v && p <= (SIZE_MAX >> 1))
+        p <<= 1;
+    return p;
+}
+
+SensorHistory::SensorHistory(size_t capacity)
+        : samples_(next_power_of_two(std::clamp<size_t>(capacity, 1, SENSOR_HISTORY_MAX_CAPACITY))),
+                                                mask_(samples_.size() - 1) {
+}
+
+void SensorHistory::push(double stamp, double value) {
+    std::unique_lock<std::mutex> lk(mutex_);
+    samples_[head_ & mask_] = {stamp, value};
+    head_++;
+    if (count_ < samples_.size())
+        count_++;
+}
+
+std::vector<HistorySample> SensorHistory::query(double since, size_t max_points) const {
+    std::unique_lock<std::mutex> lk(mutex_);
+
+    const size_t first = head_ - count_;
+
+    // Samples are pushed in stamp order, so we can binary search the start.
+    size_t lo = 0, hi = count_;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (samples_[(first + mid) & mask_].stamp < since) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    const size_t n = count_ - lo;
+    const size_t start = first + lo;
+
+    std::vector<HistorySample> result;
+    if (max_points == 0 || n <= max_points) {
+        result.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            result.push_back(samples_[(start + i) & mask_]);
+        }
+        return result;
+    }
+
+    // Downsample by averaging equally sized buckets
+    result.reserve(max_points);
+    for (size_t b = 0; b < max_points; b++) {
+        const size_t bucket_begin = b * n / max_points;
+        const size_t bucket_end = (b + 1) * n / max_points;
+        double stamp_sum = 0, value_sum = 0;
+        for (size_t i = bucket_begin; i < bucket_end; i++) {
+            const auto &s = samples_[(start + i) & mask_];
+            stamp_sum += s.stamp;
+            value_sum += s.value;
+        }
+        const double count = static_cast<double>(bucket_end - bucket_begin);
+        result.push_back({stamp_sum / count, value_sum / count});
+    }
+    return result;
+}
+
+size_t SensorHistory::size() const {
+    std::unique_lock<std::mutex> lk(mutex_);
+    return count_;
+}
@@ -0,0 +1,274 @@
+//
+// Throughput and latency harness for the bridge core. Drives it with synthetic inputs as fast as possible and
+// replaces the broker with an in-process sink, so neither ROS nor Mosquitto are needed.
+// Latency is measured from handing an input to the core to each message it publishes (or sends to the robot) for it.
+// Prints the results as JSON, see "Throughput Harness" in the README.
+//
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include "xbot_monitoring/bridge.h"
+#include "xbot_monitoring/bson_writer.h"
+#include "xbot_monitoring/process_stats.h"
+#include "xbot_monitoring/synthetic_messages.h"
+
+using json = nlohmann::json;
+
+namespace {
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// When the current input was handed to the core. The core publishes on the calling thread for all inputs used here.
+thread_local uint64_t input_start_ns = 0;
+
+// Records the latency of everything leaving the core
+class Sink {
+public:
+    void record(size_t size) {
+        const uint64_t latency = now_ns() - input_start_ns;
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (!recording_)
+            return;
+        latencies_.push_back(latency);
+        bytes_ += size;
+    }
+
+    void start() {
+        std::lock_guard<std::mutex> lk(mutex_);
+        latencies_.clear();
+        bytes_ = 0;
+        recording_ = true;
+    }
+
+    // Returns the latencies in ns
+    std::vector<uint64_t> stop(uint64_t &bytes) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        recording_ = false;
+        bytes = bytes_;
+        return std::move(latencies_);
+    }
+
+private:
+    std::mutex mutex_;
+    bool recording_ = false;
+    std::vector<uint64_t> latencies_;
+    uint64_t bytes_ = 0;
+};
+
+Sink sink;
+
+class SinkEgress : public Egress {
+public:
+    bool is_connected() override {
+        return true;
+    }
+
+    bool publish(const std::string &, const void *, size_t size, bool) override {
+        sink.record(size);
+        return true;
+    }
+
+    void subscribe(const std::string &) override {
+    }
+
+    size_t pending() override {
+        return 0;
+    }
+};
+
+class SinkIngress : public Ingress {
+public:
+    void send_cmd_vel(double, double) override {
+        sink.record(sizeof(double) * 2);
+    }
+
+    void send_action(const std::string &action_id) override {
+        sink.record(action_id.size());
+    }
+
+    void send_command(const std::string &command) override {
+        sink.record(command.size());
+    }
+};
+
+struct Scenario {
+    std::string name;
+    // Feeds input number i to the core
+    std::function<void(uint64_t i)> input;
+};
+
+double percentile_us(const std::vector<uint64_t> &sorted, double p) {
+    if (sorted.empty())
+        return 0.0;
+    const size_t index = std::min(sorted.size() - 1, static_cast<size_t>(std::ceil(p * sorted.size())) - 1);
+    return sorted[index] / 1000.0;
+}
+
+json run_scenario(const Scenario &scenario, double duration) {
+    // Warm up caches and allocators
+    for (uint64_t i = 0; i < 1000; i++) {
+        input_start_ns = now_ns();
+        scenario.input(i);
+    }
+
+    ProcessStats stats_before, stats_after;
+    read_process_stats(stats_before);
+    sink.start();
+    const uint64_t start = now_ns();
+    const uint64_t end = start + static_cast<uint64_t>(duration * 1e9);
+    uint64_t inputs = 0;
+    uint64_t now = start;
+    while (now < end) {
+        // Don't read the clock twice per input
+        for (int k = 0; k < 64; k++) {
+            input_start_ns = now_ns();
+            scenario.input(1000 + inputs++);
+        }
+        now = now_ns();
+    }
+    uint64_t bytes;
+    std::vector<uint64_t> latencies = sink.stop(bytes);
+    read_process_stats(stats_after);
+    const double seconds = (now - start) / 1e9;
+    std::sort(latencies.begin(), latencies.end());
+
+    json result;
+    result["name"] = scenario.name;
+    result["seconds"] = seconds;
+    result["inputs"] = inputs;
+    result["messages"] = latencies.size();
+    result["bytes"] = bytes;
+    result["inputs_per_s"] = inputs / seconds;
+    result["msgs_per_s"] = latencies.size() / seconds;
+    result["latency_us"] = {
+            {"p50",  percentile_us(latencies, 0.5)},
+            {"p99",  percentile_us(latencies, 0.99)},
+            {"p999", percentile_us(latencies, 0.999)},
+            {"max",  latencies.empty() ? 0.0 : latencies.back() / 1000.0},
+    };
+    // Includes the bridge's own threads, e.g. the inbound worker
+    result["cpu_us_per_msg"] = latencies.empty() ? 0.0 :
+                               (stats_after.cpu_time - stats_before.cpu_time) * 1e6 / latencies.size();
+    return result;
+}
+
+std::vector<const Sensor *> add_sensors(const std::string &prefix, int count, uint8_t value_type) {
+    std::vector<const Sensor *> sensors;
+    for (int i = 0; i < count; i++) {
+        xbot_msgs::SensorInfo info;
+        info.sensor_id = prefix + std::to_string(i);
+        info.sensor_name = info.sensor_id;
+        info.value_type = value_type;
+        if (value_type == xbot_msgs::SensorInfo::TYPE_DOUBLE) {
+            info.has_min_max = true;
+            info.min_value = 0.0;
+            info.max_value = 30.0;
+            info.has_critical_low = true;
+            info.lower_critical_value = 5.0;
+        }
+        sensors.push_back(add_sensor("/xbot_monitoring/sensors/" + info.sensor_id + "/info", info));
+    }
+    return sensors;
+}
+
+void usage() {
+    std::cerr << "usage: xbot_throughput_harness [--duration <s>] [--sensors <n>] [--scenario <name>] [--output <file>]"
+              << std::endl;
+}
+}
+
+int main(int argc, char **argv) {
+    double duration = 2.0;
+    int sensor_count = 100;
+    std::string only_scenario;
+    std::string output;
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--duration") == 0 && has_value) {
+            duration = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--sensors") == 0 && has_value) {
+            sensor_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--scenario") == 0 && has_value) {
+            only_scenario = argv[++i];
+        } else if (std::strcmp(argv[i], "--output") == 0 && has_value) {
+            output = argv[++i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (duration <= 0 || sensor_count <= 0) {
+        usage();
+        return 1;
+    }
+
+    ros::Time::init();
+
+    // The production defaults, the periodic tasks are left out
+    BridgeConfig config;
+    SinkEgress egress;
+    SinkIngress ingress;
+    bridge_init(config, egress, ingress);
+    bridge_start();
+    handle_connected();
+
+    const auto double_sensors = add_sensors("harness_double_", sensor_count, xbot_msgs::SensorInfo::TYPE_DOUBLE);
+    const auto string_sensors = add_sensors("harness_string_", sensor_count, xbot_msgs::SensorInfo::TYPE_STRING);
+    const char *const string_values[] = {"IDLE", "MOWING", "DOCKING", "CHARGING"};
+
+    std::vector<Scenario> scenarios;
+    scenarios.push_back({"sensor_double", [&](uint64_t i) {
+        sensor_double_callback(*double_sensors[i % double_sensors.size()], 15.0 + 10.0 * std::sin(i / 100.0),
+                               ros::Time::now());
+    }});
+    scenarios.push_back({"sensor_string", [&](uint64_t i) {
+        sensor_string_callback(*string_sensors[i % string_sensors.size()], string_values[(i / 64) % 4],
+                               ros::Time::now());
+    }});
+    scenarios.push_back({"robot_state", [](uint64_t i) {
+        robot_state_callback(make_robot_state(i / 100.0, ros::Time::now()));
+    }});
+    scenarios.push_back({"map_overlay", [](uint64_t i) {
+        map_overlay_callback(make_map_overlay(10, 20, i));
+    }});
+    scenarios.push_back({"teleop", [](uint64_t i) {
+        BsonWriter command;
+        command.add_double("vx", 0.5);
+        command.add_double("vz", 0.1);
+        command.add_int64("seq", static_cast<int64_t>(i + 1));
+        handle_inbound_message(std::make_shared<InboundMessage>(InboundMessage{"/teleop", command.finish()}));
+    }});
+
+    json results;
+    results["duration_s"] = duration;
+    results["sensors"] = sensor_count;
+    results["scenarios"] = json::array();
+    for (const auto &scenario: scenarios) {
+        if (!only_scenario.empty() && scenario.name != only_scenario)
+            continue;
+        results["scenarios"].push_back(run_scenario(scenario, duration));
+    }
+    bridge_stop();
+
+    if (output.empty()) {
+        std::cout << results.dump(2) << std::endl;
+    } else {
+        std::ofstream out(output);
+        out << results.dump(2) << std::endl;
+        if (!out) {
+            std::cerr << "Could not write " << output << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include "xbot_monitoring/trace.h"
+
+#include <atomic>
+#include <fstream>
+
+#ifdef XBOT_TRACE
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace {
+// Fields are atomic so the dumping thread can read while the owner writes,
+// spans which got overwritten during the copy are dropped afterwards.
+struct TraceEvent {
+    std::atomic<const char *> name{nullptr};
+    std::atomic<uint64_t> start_ns{0};
+    std::atomic<uint64_t> duration_ns{0};
+};
+
+struct ThreadBuffer {
+    long tid = 0;
+    std::atomic<const char *> thread_name{nullptr};
+    // Number of spans ever written, only incremented by the owning thread
+    std::atomic<uint64_t> head{0};
+    TraceEvent events[TRACE_BUFFER_SIZE];
+};
+
+std::mutex buffers_mutex;
+// Buffers are kept after their thread exits, so its spans still show up in the dump
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+ThreadBuffer &local_buffer() {
+    thread_local ThreadBuffer *buffer = [] {
+        auto b = std::make_unique<ThreadBuffer>();
+        b->tid = syscall(SYS_gettid);
+        std::unique_lock<std::mutex> lk(buffers_mutex);
+        buffers.push_back(std::move(b));
+        return buffers.back().get();
+    }();
+    return *buffer;
+}
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+TraceScope::TraceScope(const char *name) : name_(name), start_ns_(now_ns()) {
+}
+
+TraceScope::~TraceScope() {
+    const uint64_t end_ns = now_ns();
+    auto &buffer = local_buffer();
+    const uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    auto &event = buffer.events[head % TRACE_BUFFER_SIZE];
+    event.name.store(name_, std::memory_order_relaxed);
+    event.start_ns.store(start_ns_, std::memory_order_relaxed);
+    event.duration_ns.store(end_ns - start_ns_, std::memory_order_relaxed);
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void trace_thread_name(const char *name) {
+    local_buffer().thread_name.store(name, std::memory_order_relaxed);
+}
+
+bool trace_dump(const std::string &path) {
+    std::ofstream out(path);
+    if (!out)
+        return false;
+
+    const long pid = getpid();
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    std::unique_lock<std::mutex> lk(buffers_mutex);
+    for (const auto &buffer: buffers) {
+        const char *thread_name = buffer->thread_name.load(std::memory_order_relaxed);
+        if (thread_name) {
+            out << (first ? "" : ",") << "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid
+                << ",\"tid\":" << buffer->tid << ",\"args\":{\"name\":\"" << thread_name << "\"}}";
+            first = false;
+        }
+
+        const uint64_t head = buffer->head.load(std::memory_order_acquire);
+        const uint64_t begin = head > TRACE_BUFFER_SIZE ? head - TRACE_BUFFER_SIZE : 0;
+        struct Span {
+            const char *name;
+            uint64_t start_ns;
+            uint64_t duration_ns;
+        };
+        std::vector<Span> spans;
+        spans.reserve(head - begin);
+        for (uint64_t i = begin; i < head; i++) {
+            const auto &event = buffer->events[i % TRACE_BUFFER_SIZE];
+            spans.push_back({event.name.load(std::memory_order_relaxed),
+                             event.start_ns.load(std::memory_order_relaxed),
+                             event.duration_ns.load(std::memory_order_relaxed)});
+        }
+        // Everything the owner wrote in the meantime may have overwritten the oldest spans.
+        // It may also be writing slot head_after right now, which holds the oldest span once the ring is full.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t head_after = buffer->head.load(std::memory_order_relaxed);
+        const uint64_t valid_begin = head_after >= TRACE_BUFFER_SIZE ? head_after - TRACE_BUFFER_SIZE + 1 : 0;
+
+        for (uint64_t i = std::max(begin, valid_begin); i < head; i++) {
+            const auto &span = spans[i - begin];
+            out << (first ? "" : ",") << "\n{\"ph\":\"X\",\"name\":\"" << span.name << "\",\"pid\":" << pid
+                << ",\"tid\":" << buffer->tid << ",\"ts\":" << span.start_ns / 1000 << "." << (span.start_ns % 1000) / 100
+                << ",\"dur\":" << span.duration_ns / 1000 << "." << (span.duration_ns % 1000) / 100 << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
+
+#else
+
+bool trace_dump(const std::string &) {
+    return false;
+}
+
+#endif
+
+namespace {
+std::atomic<bool> dump_requested{false};
+}
+
+void trace_request_dump() {
+    dump_requested.store(true, std::memory_order_relaxed);
+}
+
+bool trace_dump_requested() {
+    return dump_requested.exchange(false, std::memory_order_relaxed);
+}
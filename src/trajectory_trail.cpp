@@ -0,0 +1,29 @@
+#include "xbot_monitoring/trajectory_trail.h"
+
+#include <cmath>
+
+TrajectoryTrail::TrajectoryTrail(double min_distance, double min_angle, double max_age, size_t max_points)
+        : min_distance_(min_distance), min_angle_(min_angle), max_age_(max_age), max_points_(max_points) {
+}
+
+bool TrajectoryTrail::add(double stamp, double x, double y, double heading) {
+    if (!points_.empty()) {
+        const auto &last = points_.back();
+        const double distance = std::hypot(x - last.x, y - last.y);
+        const double angle = std::abs(std::remainder(heading - last.heading, 2.0 * M_PI));
+        if (distance < min_distance_ && angle < min_angle_)
+            return false;
+    }
+
+    points_.push_back({stamp, x, y, heading, next_seq_++});
+    prune(stamp);
+    return true;
+}
+
+bool TrajectoryTrail::prune(double stamp) {
+    const size_t size = points_.size();
+    while (!points_.empty() && (points_.size() > max_points_ || stamp - points_.front().stamp > max_age_)) {
+        points_.pop_front();
+    }
+    return points_.size() != size;
+}
@@ -0,0 +1,96 @@
+//
+// Prints the records of xbot_monitoring history log segments as CSV.
+// Usage: xbot_log_dump <segment files or log directory>...
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "xbot_monitoring/history_log.h"
+
+static std::string record_text(const LogRecord &record) {
+    return std::string(record.text, strnlen(record.text, sizeof(record.text)));
+}
+
+static bool dump_segment(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        fprintf(stderr, "could not open %s\n", path.c_str());
+        return false;
+    }
+
+    LogSegmentHeader header{};
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!file || memcmp(header.magic, XBOT_LOG_MAGIC, sizeof(XBOT_LOG_MAGIC)) != 0 ||
+        header.version != XBOT_LOG_VERSION || header.record_size != sizeof(LogRecord)) {
+        fprintf(stderr, "%s is not a supported history log segment\n", path.c_str());
+        return false;
+    }
+
+    std::map<uint16_t, std::string> channels;
+    LogRecord record{};
+    // Don't trust record_count, the writer may have died before updating it. Empty records end the segment.
+    for (uint64_t i = 0; i < header.capacity; i++) {
+        file.read(reinterpret_cast<char *>(&record), sizeof(record));
+        if (!file || record.stamp_ns == 0)
+            break;
+
+        const double stamp = static_cast<double>(record.stamp_ns) / 1e9;
+        switch (record.type) {
+            case LOG_RECORD_CHANNEL:
+                channels[record.channel] = record_text(record);
+                break;
+            case LOG_RECORD_SENSOR_DOUBLE:
+                printf("%.6f,sensor,%s,%.9g\n", stamp, channels[record.channel].c_str(), record.values[0]);
+                break;
+            case LOG_RECORD_SENSOR_STRING:
+                printf("%.6f,sensor,%s,\"%s\"\n", stamp, channels[record.channel].c_str(), record_text(record).c_str());
+                break;
+            case LOG_RECORD_ROBOT_POSE:
+                printf("%.6f,robot_pose,%.4f,%.4f,%.4f,%u\n", stamp, record.values[0], record.values[1],
+                       record.values[2], record.flags & 1u);
+                break;
+            case LOG_RECORD_ROBOT_STATUS:
+                printf("%.6f,robot_status,%.2f,%.2f,%.2f,%u,%u,\"%s\"\n", stamp, record.values[0], record.values[1],
+                       record.values[2], record.flags & 1u, (record.flags >> 1) & 1u, record_text(record).c_str());
+                break;
+            default:
+                fprintf(stderr, "%s: skipping unknown record type %u\n", path.c_str(), record.type);
+                break;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <segment files or log directory>...\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> segments;
+    for (int i = 1; i < argc; i++) {
+        if (std::filesystem::is_directory(argv[i])) {
+            for (const auto &entry: std::filesystem::directory_iterator(argv[i])) {
+                if (entry.path().extension() == ".xlog")
+                    segments.push_back(entry.path().string());
+            }
+        } else {
+            segments.emplace_back(argv[i]);
+        }
+    }
+    // Segment names are zero padded, so this is chronological
+    std::sort(segments.begin(), segments.end());
+
+    bool ok = true;
+    for (const auto &segment: segments) {
+        ok &= dump_segment(segment);
+    }
+    return ok ? 0 : 1;
+}
@@ -2,482 +2,320 @@
 // Created by Clemens Elflein on 22.11.22.
 // Copyright (c) 2022 Clemens Elflein. All rights reserved.
 //
-#include <filesystem>
+// The ROS node: connects the bridge in bridge.cpp to ROS and to the MQTT broker.
+//
+#include <csignal>
+#include <map>
+#include <memory>
+#include <vector>
 
 #include "ros/ros.h"
-#include <memory>
+#include "ros/callback_queue.h"
 #include <boost/regex.hpp>
+#include <mqtt/async_client.h>
 #include "xbot_msgs/SensorInfo.h"
-#include "xbot_msgs/Map.h"
 #include "xbot_msgs/SensorDataString.h"
 #include "xbot_msgs/SensorDataDouble.h"
-#include "xbot_msgs/RobotState.h"
-#include <mqtt/async_client.h>
-#include <nlohmann/json.hpp>
+#include "xbot_msgs/RegisterActionsSrv.h"
 #include "geometry_msgs/Twist.h"
 #include "std_msgs/String.h"
-#include "xbot_msgs/RegisterActionsSrv.h"
-#include "xbot_msgs/ActionInfo.h"
-#include "xbot_msgs/MapOverlay.h"
-
-using json = nlohmann::json;
+#include "std_srvs/Trigger.h"
+#include "xbot_monitoring/bridge.h"
+#include "xbot_monitoring/metrics.h"
+#include "xbot_monitoring/metrics_http.h"
+#include "xbot_monitoring/trace.h"
 
-void publish_sensor_metadata();
-void publish_map();
-void publish_map_overlay();
-void publish_actions();
-
-// Stores registered actions (prefix to vector<action>)
-std::map<std::string, std::vector<xbot_msgs::ActionInfo>> registered_actions;
+ros::NodeHandle *n;
 
 // Maps a topic to a subscriber.
 std::map<std::string, ros::Subscriber> active_subscribers;
-std::map<std::string, xbot_msgs::SensorInfo> found_sensors;
 std::vector<ros::Subscriber> sensor_data_subscribers;
 
-ros::NodeHandle *n;
-
-// The MQTT Client
-std::shared_ptr<mqtt::async_client> client_;
-
-std::mutex mqtt_callback_mutex;
-
-// Publisher for cmd_vel and commands
-ros::Publisher cmd_vel_pub;
-ros::Publisher action_pub;
-
-class MqttCallback : public mqtt::callback {
-    void connected(const mqtt::string &string) override {
-        ROS_INFO_STREAM("MQTT Connected");
-        publish_sensor_metadata();
-        publish_map();
-        publish_map_overlay();
-        publish_actions();
-
-
-        client_->subscribe("/teleop", 0);
-        client_->subscribe("/command", 0);
-        client_->subscribe("/action", 0);
-    }
-
+class MqttEgress : public Egress, public mqtt::callback {
 public:
-    void message_arrived(mqtt::const_message_ptr ptr) override {
-        if(ptr->get_topic() == "/teleop") {
-            ROS_INFO_STREAM("joy!");
-            try {
-                json json = json::from_bson(ptr->get_payload().begin(), ptr->get_payload().end());
-
-                ROS_INFO_STREAM_THROTTLE(0.5,"vx:" << json["vx"] << " vr: " << json["vz"]);
-                geometry_msgs::Twist t;
-                t.linear.x = json["vx"];
-                t.angular.z = json["vz"];
-                cmd_vel_pub.publish(t);
-            } catch (const json::exception &e) {
-                ROS_ERROR_STREAM("Error decoding /teleop bson: " << e.what());
-            }
-        } else if(ptr->get_topic() == "/action") {
-            ROS_INFO_STREAM("Got action: " + ptr->get_payload());
-            std_msgs::String action_msg;
-            action_msg.data = ptr->get_payload_str();
-            action_pub.publish(action_msg);
+    void connect() {
+        // MQTT connection options
+        mqtt::connect_options connect_options_;
+
+        // basic client connection options
+        connect_options_.set_automatic_reconnect(true);
+        connect_options_.set_clean_session(true);
+        connect_options_.set_keep_alive_interval(1000);
+        connect_options_.set_max_inflight(10);
+
+        // create MQTT client
+        std::string uri = "tcp" + std::string("://") + "127.0.0.1" +
+                          std::string(":") + std::to_string(1883);
+
+        try {
+            client_ = std::make_shared<mqtt::async_client>(
+                    uri, "xbot_monitoring");
+            client_->set_callback(*this);
+
+            client_->connect(connect_options_);
+
+        } catch (const mqtt::exception &e) {
+            ROS_ERROR("Client could not be initialized: %s", e.what());
+            exit(EXIT_FAILURE);
         }
     }
-};
-
-MqttCallback mqtt_callback;
-
-json map;
-json map_overlay;
-bool has_map = false;
-bool has_map_overlay = false;
-
-void setupMqttClient() {
-    // MQTT connection options
-    mqtt::connect_options connect_options_;
-
-    // basic client connection options
-    connect_options_.set_automatic_reconnect(true);
-    connect_options_.set_clean_session(true);
-    connect_options_.set_keep_alive_interval(1000);
-    connect_options_.set_max_inflight(10);
-
-    // create MQTT client
-    std::string uri = "tcp" + std::string("://") + "127.0.0.1" +
-                      std::string(":") + std::to_string(1883);
-
-    try {
-        client_ = std::make_shared<mqtt::async_client>(
-                uri, "xbot_monitoring");
-        client_->set_callback(mqtt_callback);
-
-        client_->connect(connect_options_);
-
-    } catch (const mqtt::exception &e) {
-        ROS_ERROR("Client could not be initialized: %s", e.what());
-        exit(EXIT_FAILURE);
-    }
-
-
-}
 
-void try_publish(std::string topic, std::string data, bool retain = false) {
-    try {
-        if (retain) {
-            // QOS 1 so that the data actually arrives at the client at least once.
-            client_->publish(topic, data, 1, true);
-        } else {
-            client_->publish(topic, data);
-        }
-    } catch (const mqtt::exception &e) {
-        // client disconnected or something, we drop it.
-    }
-}
-void try_publish_binary(std::string topic, const void *data, size_t size, bool retain = false) {
-    try {
-        if (retain) {
-            // QOS 1 so that the data actually arrives at the client at least once.
-            client_->publish(topic, data, size, 1, true);
-        } else {
-            client_->publish(topic, data, size);
-        }
-    } catch (const mqtt::exception &e) {
-        // client disconnected or something, we drop it.
+    bool is_connected() override {
+        return client_ && client_->is_connected();
     }
-}
-
-void publish_sensor_metadata() {
-    std::unique_lock<std::mutex> lk(mqtt_callback_mutex);
 
-    if(found_sensors.empty())
-        return;
-
-    json sensor_info;
-    for (const auto &kv: found_sensors) {
-        json info;
-        info["sensor_id"] = kv.second.sensor_id;
-        info["sensor_name"] = kv.second.sensor_name;
-
-        switch (kv.second.value_type) {
-            case xbot_msgs::SensorInfo::TYPE_STRING: {
-                info["value_type"] = "STRING";
-                break;
-            }
-            case xbot_msgs::SensorInfo::TYPE_DOUBLE: {
-                info["value_type"] = "DOUBLE";
-                break;
-            }
-            default: {
-                info["value_type"] = "UNKNOWN";
-                break;
+    bool publish(const std::string &topic, const void *data, size_t size, bool retain) override {
+        try {
+            XBOT_TRACE_SCOPE("paho publish");
+            if (retain) {
+                // QOS 1 so that the data actually arrives at the client at least once.
+                client_->publish(topic, data, size, 1, true);
+            } else {
+                client_->publish(topic, data, size);
             }
-
-
+            return true;
+        } catch (const mqtt::exception &e) {
+            return false;
         }
-
-        switch (kv.second.value_description) {
-            case xbot_msgs::SensorInfo::VALUE_DESCRIPTION_TEMPERATURE: {
-                info["value_description"] = "TEMPERATURE";
-                break;
-            }
-            case xbot_msgs::SensorInfo::VALUE_DESCRIPTION_VELOCITY: {
-                info["value_description"] = "VELOCITY";
-                break;
-            }
-            case xbot_msgs::SensorInfo::VALUE_DESCRIPTION_ACCELERATION: {
-                info["value_description"] = "ACCELERATION";
-                break;
-            }
-            case xbot_msgs::SensorInfo::VALUE_DESCRIPTION_VOLTAGE: {
-                info["value_description"] = "VOLTAGE";
-                break;
-            }
-            case xbot_msgs::SensorInfo::VALUE_DESCRIPTION_CURRENT: {
-                info["value_description"] = "CURRENT";
-                break;
-            }
-            case xbot_msgs::SensorInfo::VALUE_DESCRIPTION_PERCENT: {
-                info["value_description"] = "PERCENT";
-                break;
-            }
-            default: {
-                info["value_description"] = "UNKNOWN";
-                break;
-            }
-        }
-
-        info["unit"] = kv.second.unit;
-        info["has_min_max"] = kv.second.has_min_max;
-        info["min_value"] = kv.second.min_value;
-        info["max_value"] = kv.second.max_value;
-        info["has_critical_low"] = kv.second.has_critical_low;
-        info["lower_critical_value"] = kv.second.lower_critical_value;
-        info["has_critical_high"] = kv.second.has_critical_high;
-        info["upper_critical_value"] = kv.second.upper_critical_value;
-        sensor_info.push_back(info);
     }
-    try_publish("sensor_infos/json", sensor_info.dump(), true);
-    json data;
-    data["d"] = sensor_info;
-    auto bson = json::to_bson(data);
-    try_publish_binary("sensor_infos/bson", bson.data(), bson.size(), true);
-}
-
-void subscribe_to_sensor(std::string topic) {
-    auto &sensor = found_sensors[topic];
-
-    ROS_INFO_STREAM("Subscribing to sensor data for sensor with name: " << sensor.sensor_name);
 
-    std::string data_topic = "xbot_monitoring/sensors/" + sensor.sensor_id + "/data";
-
-    switch (sensor.value_type) {
-        case xbot_msgs::SensorInfo::TYPE_DOUBLE: {
-            ros::Subscriber s = n->subscribe<xbot_msgs::SensorDataDouble>(data_topic, 10, [&info = sensor](
-                    const xbot_msgs::SensorDataDouble::ConstPtr &msg) {
-                try_publish("sensors/" + info.sensor_id + "/data", std::to_string(msg->data));
-
-                json data;
-                data["d"] = msg->data;
-                auto bson = json::to_bson(data);
-                try_publish_binary("sensors/" + info.sensor_id + "/bson", bson.data(), bson.size());
-            });
-            sensor_data_subscribers.push_back(s);
-            break;
-        }
-        case xbot_msgs::SensorInfo::TYPE_STRING: {
-            ros::Subscriber s = n->subscribe<xbot_msgs::SensorDataString>(data_topic, 10, [&info = sensor](
-                    const xbot_msgs::SensorDataString::ConstPtr &msg) {
-                try_publish("sensors/" + info.sensor_id + "/data", msg->data);
-
-                json data;
-                data["d"] = msg->data;
-                auto bson = json::to_bson(data);
-                try_publish_binary("sensors/" + info.sensor_id + "/bson", bson.data(), bson.size());
-            });
-            sensor_data_subscribers.push_back(s);
-            break;
-        }
-        default: {
-            ROS_ERROR_STREAM("Inavlid Sensor Data Type: " << (int) sensor.value_type);
-        }
+    void subscribe(const std::string &filter) override {
+        client_->subscribe(filter, 0);
     }
-}
 
-void robot_state_callback(const xbot_msgs::RobotState::ConstPtr &msg) {
-    // Build a JSON and publish it
-    json j;
-
-    j["battery_percentage"] = msg->battery_percentage;
-    j["gps_percentage"] = msg->gps_percentage;
-    j["current_action_progress"] = msg->current_action_progress;
-    j["current_state"] = msg->current_state;
-    j["current_sub_state"] = msg->current_sub_state;
-    j["emergency"] = msg->emergency;
-    j["is_charging"] = msg->is_charging;
-    j["pose"]["x"] = msg->robot_pose.pose.pose.position.x;
-    j["pose"]["y"] = msg->robot_pose.pose.pose.position.y;
-    j["pose"]["heading"] = msg->robot_pose.vehicle_heading;
-    j["pose"]["pos_accuracy"] = msg->robot_pose.position_accuracy;
-    j["pose"]["heading_accuracy"] = msg->robot_pose.orientation_accuracy;
-    j["pose"]["heading_valid"] = msg->robot_pose.orientation_valid;
-
-    try_publish("robot_state/json", j.dump());
-    json data;
-    data["d"] = j;
-    auto bson = json::to_bson(data);
-    try_publish_binary("robot_state/bson", bson.data(), bson.size());
-}
-
-void publish_actions() {
-    json actions = json::array();
-    for(const auto &kv : registered_actions) {
-        for(const auto &action : kv.second) {
-            json action_info;
-            action_info["action_id"] = kv.first + "/" + action.action_id;
-            action_info["action_name"] = action.action_name;
-            action_info["enabled"] = action.enabled;
-            actions.push_back(action_info);
-        }
+    size_t pending() override {
+        return client_ ? client_->get_pending_delivery_tokens().size() : 0;
     }
 
-    try_publish("actions/json", actions.dump(), true);
-    json data;
-    data["d"] = actions;
-
-    auto bson = json::to_bson(data);
-    try_publish_binary("actions/bson", bson.data(), bson.size(), true);
-}
-
-void publish_map() {
-    if(!has_map)
-        return;
-    try_publish("map/json", map.dump(), true);
-    json data;
-    data["d"] = map;
-    auto bson = json::to_bson(data);
-    try_publish_binary("map/bson", bson.data(), bson.size(), true);
-}
-
-void publish_map_overlay() {
-    if(!has_map_overlay)
-        return;
-    try_publish("map_overlay/json", map_overlay.dump(), true);
-    json data;
-    data["d"] = map_overlay;
-    auto bson = json::to_bson(data);
-    try_publish_binary("map_overlay/bson", bson.data(), bson.size(), true);
-}
-
-void map_callback(const xbot_msgs::Map::ConstPtr &msg) {
-    // Build a JSON and publish it
-    json j;
-
-    j["docking_pose"]["x"] = msg->dockX;
-    j["docking_pose"]["y"] = msg->dockY;
-    j["docking_pose"]["heading"] = msg->dockHeading;
-
-    j["meta"]["mapWidth"] = msg->mapWidth;
-    j["meta"]["mapHeight"] = msg->mapHeight;
-    j["meta"]["mapCenterX"] = msg->mapCenterX;
-    j["meta"]["mapCenterY"] = msg->mapCenterY;
-
-
-    json working_areas_j;
-    for(const auto &area : msg->workingArea) {
-        json area_j;
-        area_j["name"] = area.name;
-        {
-            json outline_poly_j;
-            for (const auto &pt: area.area.points) {
-                json p_j;
-                p_j["x"] = pt.x;
-                p_j["y"] = pt.y;
-                outline_poly_j.push_back(p_j);
-            }
-            area_j["outline"] = outline_poly_j;
-        }
-        json obstacle_polys_j;
-        for(const auto &obstacle : area.obstacles) {
-            json obstacle_poly_j;
-            for(const auto &pt : obstacle.points) {
-                json p_j;
-                p_j["x"] = pt.x;
-                p_j["y"] = pt.y;
-                obstacle_poly_j.push_back(p_j);
-            }
-            obstacle_polys_j.push_back(obstacle_poly_j);
-        }
-        area_j["obstacles"] = obstacle_polys_j;
-        working_areas_j.push_back(area_j);
+    void connected(const mqtt::string &string) override {
+        handle_connected();
     }
-    json navigation_areas_j;
-
-    for(const auto &area : msg->navigationAreas) {
-        json area_j;
-        area_j["name"] = area.name;
-        {
-            json outline_poly_j;
-            for (const auto &pt: area.area.points) {
-                json p_j;
-                p_j["x"] = pt.x;
-                p_j["y"] = pt.y;
-                outline_poly_j.push_back(p_j);
-            }
-            area_j["outline"] = outline_poly_j;
-        }
-        json obstacle_polys_j;
-        for(const auto &obstacle : area.obstacles) {
-            json obstacle_poly_j;
-            for(const auto &pt : obstacle.points) {
-                json p_j;
-                p_j["x"] = pt.x;
-                p_j["y"] = pt.y;
-                obstacle_poly_j.push_back(p_j);
-            }
-            obstacle_polys_j.push_back(obstacle_poly_j);
-        }
-        area_j["obstacles"] = obstacle_polys_j;
-        navigation_areas_j.push_back(area_j);
+
+    void connection_lost(const mqtt::string &cause) override {
+        ROS_WARN_STREAM("MQTT Connection lost: " << cause);
+        handle_connection_lost();
     }
 
-    j["working_areas"] = working_areas_j;
-    j["navigation_areas"] = navigation_areas_j;
+    void message_arrived(mqtt::const_message_ptr ptr) override {
+        handle_inbound_message(std::make_shared<InboundMessage>(InboundMessage{ptr->get_topic(), ptr->get_payload_str()}));
+    }
 
+private:
+    // The MQTT Client
+    std::shared_ptr<mqtt::async_client> client_;
+};
 
-    map = j;
-    has_map = true;
+class RosIngress : public Ingress {
+public:
+    RosIngress() {
+        cmd_vel_pub_ = n->advertise<geometry_msgs::Twist>("xbot_monitoring/remote_cmd_vel", 1);
+        action_pub_ = n->advertise<std_msgs::String>("xbot/action", 1);
+        command_pub_ = n->advertise<std_msgs::String>("xbot_monitoring/command", 1);
+    }
 
-    publish_map();
-}
+    void send_cmd_vel(double linear_x, double angular_z) override {
+        geometry_msgs::Twist t;
+        t.linear.x = linear_x;
+        t.angular.z = angular_z;
+        cmd_vel_pub_.publish(t);
+    }
 
+    void send_action(const std::string &action_id) override {
+        std_msgs::String action_msg;
+        action_msg.data = action_id;
+        action_pub_.publish(action_msg);
+    }
 
-void map_overlay_callback(const xbot_msgs::MapOverlay::ConstPtr &msg) {
-    // Build a JSON and publish it
-
-    json polys;
-    for(const auto &poly : msg->polygons) {
-        if(poly.polygon.points.size() < 2)
-            continue;
-        json poly_j;
-        {
-            json outline_poly_j;
-            for (const auto &pt: poly.polygon.points) {
-                json p_j;
-                p_j["x"] = pt.x;
-                p_j["y"] = pt.y;
-                outline_poly_j.push_back(p_j);
-            }
-            poly_j["poly"] = outline_poly_j;
-            poly_j["is_closed"] = poly.closed;
-            poly_j["line_width"] = poly.line_width;
-            poly_j["color"] = poly.color;
-        }
-        polys.push_back(poly_j);
+    void send_command(const std::string &command) override {
+        std_msgs::String command_msg;
+        command_msg.data = command;
+        command_pub_.publish(command_msg);
     }
 
-    json j;
-    j["polygons"] = polys;
-    map_overlay = j;
-    has_map_overlay = true;
+private:
+    ros::Publisher cmd_vel_pub_;
+    ros::Publisher action_pub_;
+    ros::Publisher command_pub_;
+};
 
-    publish_map_overlay();
+void subscribe_to_sensor(const Sensor *sensor, const xbot_msgs::SensorInfo &info) {
+    ROS_INFO_STREAM("Subscribing to sensor data for sensor with name: " << info.sensor_name);
+
+    std::string data_topic = "xbot_monitoring/sensors/" + info.sensor_id + "/data";
+
+    if (info.value_type == xbot_msgs::SensorInfo::TYPE_DOUBLE) {
+        sensor_data_subscribers.push_back(n->subscribe<xbot_msgs::SensorDataDouble>(data_topic, 10, [sensor](
+                const xbot_msgs::SensorDataDouble::ConstPtr &msg) {
+            sensor_double_callback(*sensor, msg->data, msg->stamp);
+        }));
+    } else {
+        sensor_data_subscribers.push_back(n->subscribe<xbot_msgs::SensorDataString>(data_topic, 10, [sensor](
+                const xbot_msgs::SensorDataString::ConstPtr &msg) {
+            sensor_string_callback(*sensor, msg->data, msg->stamp);
+        }));
+    }
 }
 
-
 bool registerActions(xbot_msgs::RegisterActionsSrvRequest &req, xbot_msgs::RegisterActionsSrvResponse &res) {
+    register_actions(req.node_prefix, req.actions);
+    return true;
+}
 
-    ROS_INFO_STREAM("new actions registered: " << req.node_prefix << " registered " << req.actions.size() << " actions.");
+// Directory for trace dumps
+std::string trace_dir = "/tmp";
 
-    registered_actions[req.node_prefix] = req.actions;
+// Returns the path of the dump or an empty string on failure
+std::string dump_trace() {
+    const std::string path = trace_dir + "/xbot_monitoring_trace_" +
+                             std::to_string(ros::WallTime::now().toNSec() / 1000000) + ".json";
+    if (!trace_dump(path)) {
+        ROS_ERROR_STREAM("Could not write trace to " << path);
+        return "";
+    }
+    ROS_INFO_STREAM("Wrote trace to " << path);
+    return path;
+}
 
-    publish_actions();
+bool dump_trace_service(std_srvs::TriggerRequest &req, std_srvs::TriggerResponse &res) {
+    res.message = dump_trace();
+    res.success = !res.message.empty();
     return true;
 }
 
 int main(int argc, char **argv) {
     ros::init(argc, argv, "xbot_monitoring");
-    has_map = false;
-    has_map_overlay = false;
-
-    // First setup MQTT
-    setupMqttClient();
-
+    trace_thread_name("main");
 
     n = new ros::NodeHandle();
     ros::NodeHandle paramNh("~");
 
+    BridgeConfig config;
+    paramNh.param("offline_buffer_topics", config.offline_buffer_topics, config.offline_buffer_topics);
+    paramNh.param("offline_buffer_mode", config.offline_buffer_mode, config.offline_buffer_mode);
+    paramNh.param("offline_buffer_max_size_kb", config.offline_buffer_max_size_kb, config.offline_buffer_max_size_kb);
+    paramNh.param("offline_buffer_spill_path", config.offline_buffer_spill_path, config.offline_buffer_spill_path);
+    paramNh.param("offline_buffer_max_spill_size_mb", config.offline_buffer_max_spill_size_mb,
+                  config.offline_buffer_max_spill_size_mb);
+    paramNh.param("offline_buffer_replay_rate", config.offline_buffer_replay_rate, config.offline_buffer_replay_rate);
+
+    paramNh.param("history_size", config.history_size, config.history_size);
+    paramNh.param("alarm_hysteresis", config.alarm_hysteresis, config.alarm_hysteresis);
+    paramNh.param("robot_state_delta", config.robot_state_delta, config.robot_state_delta);
+    paramNh.param("robot_state_keyframe_interval", config.robot_state_keyframe_interval,
+                  config.robot_state_keyframe_interval);
+    paramNh.param("robot_state_split", config.robot_state_split, config.robot_state_split);
+
+    paramNh.param("trail_enabled", config.trail_enabled, config.trail_enabled);
+    paramNh.param("trail_min_distance", config.trail_min_distance, config.trail_min_distance);
+    paramNh.param("trail_min_angle", config.trail_min_angle, config.trail_min_angle);
+    paramNh.param("trail_max_age", config.trail_max_age, config.trail_max_age);
+    paramNh.param("trail_max_points", config.trail_max_points, config.trail_max_points);
+    paramNh.param("trail_publish_interval", config.trail_publish_interval, config.trail_publish_interval);
+
+    paramNh.param("obstacle_proximity_radius", config.obstacle_proximity_radius, config.obstacle_proximity_radius);
+    paramNh.param("map_tile_size", config.map_tile_size, config.map_tile_size);
+    paramNh.param("teleop_timeout", config.teleop_timeout, config.teleop_timeout);
+    paramNh.param("teleop_max_age", config.teleop_max_age, config.teleop_max_age);
+    paramNh.param("publish_full_action_list", config.publish_full_action_list, config.publish_full_action_list);
+
+    paramNh.param("history_log_dir", config.history_log_dir, config.history_log_dir);
+    paramNh.param("history_log_segment_size_mb", config.history_log_segment_size_mb,
+                  config.history_log_segment_size_mb);
+    paramNh.param("history_log_max_segments", config.history_log_max_segments, config.history_log_max_segments);
+
+    double metrics_interval;
+    double self_monitoring_interval;
+    double sensor_latency_interval;
+    paramNh.param("sensor_latency_interval", sensor_latency_interval, 10.0);
+    paramNh.param("self_monitoring_interval", self_monitoring_interval, 5.0);
+    int prometheus_port;
+    std::string prometheus_address;
+    paramNh.param("metrics_interval", metrics_interval, 10.0);
+    paramNh.param("prometheus_port", prometheus_port, 0);
+    paramNh.param("prometheus_address", prometheus_address, std::string("127.0.0.1"));
+    paramNh.param("trace_dir", trace_dir, std::string("/tmp"));
+
+    MqttEgress egress;
+    RosIngress ingress;
+    bridge_init(config, egress, ingress);
 
     ros::ServiceServer register_action_service = n->advertiseService("xbot/register_actions", registerActions);
+    ros::ServiceServer dump_trace_server;
+    if (trace_enabled()) {
+        dump_trace_server = n->advertiseService("xbot_monitoring/dump_trace", dump_trace_service);
+        // Only sets a flag, the dump is written by the loop below
+        std::signal(SIGUSR1, [](int) { trace_request_dump(); });
+    } else {
+        // Otherwise a dump request would kill the node
+        std::signal(SIGUSR1, SIG_IGN);
+    }
 
-    ros::Subscriber robotStateSubscriber = n->subscribe("xbot_monitoring/robot_state", 10, robot_state_callback);
-    ros::Subscriber mapSubscriber = n->subscribe("xbot_monitoring/map", 10, map_callback);
-    ros::Subscriber mapOverlaySubscriber = n->subscribe("xbot_monitoring/map_overlay", 10, map_overlay_callback);
+    ros::Subscriber robotStateSubscriber = n->subscribe<xbot_msgs::RobotState>(
+            "xbot_monitoring/robot_state", 10, [](const xbot_msgs::RobotState::ConstPtr &msg) {
+                robot_state_callback(*msg);
+            });
+    ros::Subscriber mapSubscriber = n->subscribe<xbot_msgs::Map>(
+            "xbot_monitoring/map", 10, [](const xbot_msgs::Map::ConstPtr &msg) {
+                map_callback(*msg);
+            });
+    ros::Subscriber mapOverlaySubscriber = n->subscribe<xbot_msgs::MapOverlay>(
+            "xbot_monitoring/map_overlay", 10, [](const xbot_msgs::MapOverlay::ConstPtr &msg) {
+                map_overlay_callback(*msg);
+            });
 
-    cmd_vel_pub = n->advertise<geometry_msgs::Twist>("xbot_monitoring/remote_cmd_vel", 1);
-    action_pub = n->advertise<std_msgs::String>("xbot/action", 1);
+    // The deadman timer gets its own queue and spinner, so that slow callbacks like map_callback can't delay it
+    ros::CallbackQueue teleop_watchdog_queue;
+    ros::NodeHandle teleop_watchdog_nh;
+    teleop_watchdog_nh.setCallbackQueue(&teleop_watchdog_queue);
+    ros::AsyncSpinner teleop_watchdog_spinner(1, &teleop_watchdog_queue);
+    ros::WallTimer teleop_watchdog_timer;
+    if (config.teleop_timeout > 0) {
+        teleop_watchdog_timer = teleop_watchdog_nh.createWallTimer(
+                ros::WallDuration(config.teleop_timeout / 4.0),
+                [](const ros::WallTimerEvent &) { teleop_watchdog_callback(); });
+    }
+    ros::WallTimer teleop_latency_timer = n->createWallTimer(ros::WallDuration(5.0), [](const ros::WallTimerEvent &) {
+        publish_teleop_latency();
+    });
+    ros::WallTimer sensor_latency_timer;
+    if (sensor_latency_interval > 0) {
+        sensor_latency_timer = n->createWallTimer(ros::WallDuration(sensor_latency_interval),
+                                                  [](const ros::WallTimerEvent &) { publish_sensor_latency(); });
+    }
+    ros::WallTimer metrics_timer;
+    if (metrics_interval > 0) {
+        metrics_timer = n->createWallTimer(ros::WallDuration(metrics_interval),
+                                           [](const ros::WallTimerEvent &) { publish_metrics(); });
+    }
 
+    // Formats on the server thread, so scraping doesn't touch the publishing threads at all
+    MetricsHttpServer metrics_http_server;
+    if (prometheus_port > 0) {
+        if (metrics_http_server.start(prometheus_address, prometheus_port, [] {
+            return prometheus_text(metrics().snapshot());
+        })) {
+            ROS_INFO_STREAM("Serving metrics on http://" << prometheus_address << ":" << prometheus_port << "/metrics");
+        } else {
+            ROS_ERROR_STREAM("Could not serve metrics on " << prometheus_address << ":" << prometheus_port);
+        }
+    }
+
+    bridge_start();
+
+    // Setup MQTT once everything is in place, it starts publishing and dispatching right away
+    egress.connect();
+
+    // Registers the synthetic sensors, which publishes the sensor infos
+    ros::WallTimer self_monitoring_timer;
+    if (self_monitoring_interval > 0) {
+        setup_self_monitoring();
+        self_monitoring_timer = n->createWallTimer(ros::WallDuration(self_monitoring_interval),
+                                                   [](const ros::WallTimerEvent &) { self_monitoring_callback(); });
+    }
 
     ros::AsyncSpinner spinner(1);
     spinner.start();
+    teleop_watchdog_spinner.start();
 
     ros::Rate sensor_check_rate(10.0);
 
@@ -489,36 +327,28 @@ int main(int argc, char **argv) {
         ros::master::getTopics(topics);
         std::for_each(topics.begin(), topics.end(), [&](const ros::master::TopicInfo &item) {
             if (boost::regex_match(item.name, topic_regex)) {
-                if (active_subscribers.count(item.name) == 0 && found_sensors.count(item.name) == 0) {
+                if (active_subscribers.count(item.name) == 0 && !has_sensor(item.name)) {
                     ROS_INFO_STREAM("found new sensor topic " << item.name);
-                    active_subscribers[item.name] = n->subscribe<xbot_msgs::SensorInfo>(item.name, 1,
-                                                                                        [topic = item.name](
-                                                                                                const xbot_msgs::SensorInfo::ConstPtr &msg) {
-                                                                                            ROS_INFO_STREAM(
-                                                                                                    "got sensor info for sensor on topic "
-                                                                                                            << msg->sensor_name
-                                                                                                            << " on topic "
-                                                                                                            << topic);
-                                                                                            {
-                                                                                                std::unique_lock<std::mutex> lk(
-                                                                                                        mqtt_callback_mutex);
-
-                                                                                                // Save the sensor info
-                                                                                                found_sensors[topic] = *msg;
-                                                                                            }
-                                                                                            // Stop subscribing to infos
-                                                                                            active_subscribers.erase(
-                                                                                                    topic);
-                                                                                            // Subscribe for data
-                                                                                            subscribe_to_sensor(
-                                                                                                    topic);
-                                                                                            // republish sensor info
-                                                                                            publish_sensor_metadata();
-                                                                                        });
+                    active_subscribers[item.name] = n->subscribe<xbot_msgs::SensorInfo>(item.name, 1, [topic = item.name](
+                            const xbot_msgs::SensorInfo::ConstPtr &msg) {
+                        ROS_INFO_STREAM("got sensor info for sensor on topic " << msg->sensor_name << " on topic " << topic);
+                        // Stop subscribing to infos
+                        active_subscribers.erase(topic);
+                        // Save the sensor info and republish the sensor infos
+                        const Sensor *sensor = add_sensor(topic, *msg);
+                        // Subscribe for data
+                        if (sensor) {
+                            subscribe_to_sensor(sensor, *msg);
+                        }
+                    });
                 }
             }
         });
+        if (trace_dump_requested()) {
+            dump_trace();
+        }
         sensor_check_rate.sleep();
     }
+    bridge_stop();
     return 0;
 }
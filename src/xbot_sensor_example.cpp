@@ -2,16 +2,30 @@
 // Created by Clemens Elflein on 22.11.22.
 // Copyright (c) 2022 Clemens Elflein. All rights reserved.
 //
+// Publishes an example temperature sensor. With the load_* params it also generates synthetic load for the bridge,
+// see "Load Generator" in the README.
+//
+
+#include <algorithm>
+#include <cmath>
 
 #include "ros/ros.h"
 #include "xbot_msgs/SensorInfo.h"
 #include "xbot_msgs/SensorDataDouble.h"
+#include "xbot_msgs/SensorDataString.h"
+#include "xbot_monitoring/synthetic_messages.h"
 
 xbot_msgs::SensorInfo my_info;
 
-// Maps a topic to a subscriber.
-std::map<std::string, ros::Subscriber> active_subscribers;
-std::map<std::string, xbot_msgs::SensorInfo> found_sensors;
+// Synthetic sensors, the first load_sensors * load_string_ratio ones are string sensors
+struct LoadSensor {
+    xbot_msgs::SensorInfo info;
+    ros::Publisher info_publisher;
+    ros::Publisher data_publisher;
+};
+std::vector<LoadSensor> load_sensors;
+
+const char *const LOAD_STRING_VALUES[] = {"IDLE", "MOWING", "DOCKING", "CHARGING", "Waiting for GPS fix"};
 
 
 int main(int argc, char **argv) {
@@ -32,6 +46,51 @@ int main(int argc, char **argv) {
     ros::NodeHandle n;
     ros::NodeHandle paramNh("~");
 
+    // Synthetic sensors (0 to disable), published at load_rate Hz each
+    int load_sensor_count;
+    double load_string_ratio;
+    double load_rate;
+    // Messages per sensor and tick
+    int load_burst_size;
+    // Every load_burst_interval seconds the rate is multiplied by load_burst_factor for load_burst_duration seconds
+    double load_burst_interval;
+    double load_burst_duration;
+    int load_burst_factor;
+    paramNh.param("load_sensors", load_sensor_count, 0);
+    paramNh.param("load_string_ratio", load_string_ratio, 0.2);
+    paramNh.param("load_rate", load_rate, 10.0);
+    paramNh.param("load_burst_size", load_burst_size, 1);
+    paramNh.param("load_burst_interval", load_burst_interval, 0.0);
+    paramNh.param("load_burst_duration", load_burst_duration, 1.0);
+    paramNh.param("load_burst_factor", load_burst_factor, 10);
+
+    // RobotState rate in Hz (0 to disable)
+    double load_robot_state_rate;
+    paramNh.param("load_robot_state_rate", load_robot_state_rate, 0.0);
+
+    // Map with load_map_areas working areas (0 to disable), republished every load_map_interval seconds (0 for once)
+    int load_map_areas;
+    int load_map_obstacles;
+    int load_map_points;
+    double load_map_interval;
+    paramNh.param("load_map_areas", load_map_areas, 0);
+    paramNh.param("load_map_obstacles", load_map_obstacles, 2);
+    paramNh.param("load_map_points", load_map_points, 100);
+    paramNh.param("load_map_interval", load_map_interval, 0.0);
+
+    // MapOverlay with load_overlay_polygons polygons (0 to disable) at load_overlay_rate Hz
+    int load_overlay_polygons;
+    int load_overlay_points;
+    double load_overlay_rate;
+    paramNh.param("load_overlay_polygons", load_overlay_polygons, 0);
+    paramNh.param("load_overlay_points", load_overlay_points, 20);
+    paramNh.param("load_overlay_rate", load_overlay_rate, 1.0);
+
+    if (load_rate <= 0)
+        load_sensor_count = 0;
+    load_burst_size = std::max(1, load_burst_size);
+    load_burst_factor = std::max(1, load_burst_factor);
+
     ros::AsyncSpinner spinner(1);
     spinner.start();
 
@@ -39,17 +98,110 @@ int main(int argc, char **argv) {
     ros::Publisher sensor_data_publisher = n.advertise<xbot_msgs::SensorDataDouble>("xbot_monitoring/sensors/" + my_info.sensor_id + "/data", 1, false);
     sensor_info_publisher.publish(my_info);
 
+    const int load_string_count = static_cast<int>(load_sensor_count * load_string_ratio);
+    for (int i = 0; i < load_sensor_count; i++) {
+        LoadSensor sensor;
+        sensor.info.sensor_id = "load_" + std::to_string(i);
+        sensor.info.sensor_name = "Load " + std::to_string(i);
+        const std::string prefix = "xbot_monitoring/sensors/" + sensor.info.sensor_id;
+        // Enough queue for a full burst, the bridge should see every message
+        const uint32_t queue_size = static_cast<uint32_t>(load_burst_size * load_burst_factor * 2);
+        if (i < load_string_count) {
+            sensor.info.value_type = xbot_msgs::SensorInfo::TYPE_STRING;
+            sensor.data_publisher = n.advertise<xbot_msgs::SensorDataString>(prefix + "/data", queue_size, false);
+        } else {
+            sensor.info.value_type = xbot_msgs::SensorInfo::TYPE_DOUBLE;
+            sensor.info.value_description = xbot_msgs::SensorInfo::VALUE_DESCRIPTION_VOLTAGE;
+            sensor.info.unit = "V";
+            sensor.info.has_min_max = true;
+            sensor.info.min_value = 0.0;
+            sensor.info.max_value = 30.0;
+            sensor.data_publisher = n.advertise<xbot_msgs::SensorDataDouble>(prefix + "/data", queue_size, false);
+        }
+        sensor.info_publisher = n.advertise<xbot_msgs::SensorInfo>(prefix + "/info", 1, true);
+        sensor.info_publisher.publish(sensor.info);
+        load_sensors.push_back(sensor);
+    }
+    if (load_sensor_count > 0) {
+        ROS_INFO_STREAM("Publishing " << load_sensor_count << " load sensors (" << load_string_count << " string) at "
+                                      << load_rate << " Hz x " << load_burst_size);
+    }
+
+    ros::Publisher robot_state_publisher = n.advertise<xbot_msgs::RobotState>("xbot_monitoring/robot_state", 10);
+    ros::Publisher map_publisher = n.advertise<xbot_msgs::Map>("xbot_monitoring/map", 1, true);
+    ros::Publisher map_overlay_publisher = n.advertise<xbot_msgs::MapOverlay>("xbot_monitoring/map_overlay", 10, true);
+
+    const ros::WallTime start = ros::WallTime::now();
+    ros::WallTimer robot_state_timer;
+    if (load_robot_state_rate > 0) {
+        robot_state_timer = n.createWallTimer(ros::WallDuration(1.0 / load_robot_state_rate), [&](const ros::WallTimerEvent &) {
+            robot_state_publisher.publish(make_robot_state((ros::WallTime::now() - start).toSec(), ros::Time::now()));
+        });
+    }
+
+    ros::WallTimer map_timer;
+    if (load_map_areas > 0) {
+        const xbot_msgs::Map map = make_map(load_map_areas, load_map_obstacles, load_map_points);
+        map_publisher.publish(map);
+        if (load_map_interval > 0) {
+            map_timer = n.createWallTimer(ros::WallDuration(load_map_interval), [&, map](const ros::WallTimerEvent &) {
+                map_publisher.publish(map);
+            });
+        }
+    }
+
+    ros::WallTimer map_overlay_timer;
+    int map_overlay_seq = 0;
+    if (load_overlay_polygons > 0 && load_overlay_rate > 0) {
+        map_overlay_timer = n.createWallTimer(ros::WallDuration(1.0 / load_overlay_rate), [&](const ros::WallTimerEvent &) {
+            map_overlay_publisher.publish(make_map_overlay(load_overlay_polygons, load_overlay_points, map_overlay_seq++));
+        });
+    }
+
     xbot_msgs::SensorDataDouble data;
 
-    ros::Rate sensorRate(1);
+    // Ticks at the burst rate, outside of bursts only every load_burst_factor-th tick publishes
+    const bool bursts = load_sensor_count > 0 && load_burst_interval > 0 && load_burst_factor > 1;
+    const double tick_rate = load_sensor_count > 0 ? load_rate * (bursts ? load_burst_factor : 1) : 1.0;
+    ros::Rate sensorRate(tick_rate);
     int i = 0;
+    long tick = 0;
+    xbot_msgs::SensorDataDouble load_double;
+    xbot_msgs::SensorDataString load_string;
     while(ros::ok()) {
-        // Generate some data here
-        data.stamp = ros::Time::now();
-        data.data = (sin((i++) / 10.0) + 0.5) * 50.0;
+        // The example sensor stays at 1 Hz whatever the tick rate, i counts its samples
+        if ((ros::WallTime::now() - start).toSec() >= i) {
+            // Generate some data here
+            data.stamp = ros::Time::now();
+            data.data = (sin((i++) / 10.0) + 0.5) * 50.0;
+
+            // Publish the data
+            sensor_data_publisher.publish(data);
+        }
 
-        // Publish the data
-        sensor_data_publisher.publish(data);
+        bool publish_load = !load_sensors.empty();
+        if (publish_load && bursts) {
+            const bool in_burst = std::fmod((ros::WallTime::now() - start).toSec(), load_burst_interval) < load_burst_duration;
+            publish_load = in_burst || tick % load_burst_factor == 0;
+        }
+        if (publish_load) {
+            for (int b = 0; b < load_burst_size; b++) {
+                const ros::Time stamp = ros::Time::now();
+                for (size_t s = 0; s < load_sensors.size(); s++) {
+                    auto &sensor = load_sensors[s];
+                    if (sensor.info.value_type == xbot_msgs::SensorInfo::TYPE_STRING) {
+                        load_string.stamp = stamp;
+                        load_string.data = LOAD_STRING_VALUES[(tick + s) % 5];
+                        sensor.data_publisher.publish(load_string);
+                    } else {
+                        load_double.stamp = stamp;
+                        load_double.data = 24.0 + std::sin(tick / 20.0 + s);
+                        sensor.data_publisher.publish(load_double);
+                    }
+                }
+            }
+        }
+        tick++;
         sensorRate.sleep();
     }
 